@@ -19,7 +19,7 @@ BuildRequires: globus-gsi-cert-utils-devel
 BuildRequires: globus-gsi-credential-devel
 BuildRequires: globus-gsi-sysconfig-devel
 BuildRequires: libuuid-devel
-BuildRequires: openssl-devel
+BuildRequires: openssl-devel >= 1.1.1
 BuildRequires: pkgconfig
 BuildRequires: voms-devel
 BuildRequires: scitokens-cpp-devel
@@ -66,6 +66,7 @@ rm -rf $RPM_BUILD_ROOT
 %defattr(-,root,root)
 /usr/libexec/cvmfs/authz/cvmfs_x509_helper
 /usr/libexec/cvmfs/authz/cvmfs_x509_validator
+/usr/libexec/cvmfs/authz/cvmfs_x509_bundle_builder
 /usr/lib64/libcvmfs_scitoken_helper.so
 /usr/libexec/cvmfs/authz/cvmfs_scitoken_helper
 %doc COPYING AUTHORS README ChangeLog
@@ -0,0 +1,180 @@
+/**
+ * This file is part of the CernVM File System.
+ *
+ * Compares the Base64 codec against the previous block-at-a-time
+ * implementation on membership-sized and proxy-sized inputs.  Built with
+ * -DBUILD_BENCHMARKS=ON, not installed.
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "x509_helper_base64.h"
+
+using namespace std;  // NOLINT
+
+namespace {
+
+const char b64_table[] = {'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K',
+  'L', 'M', 'N', 'O', 'P', 'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z',
+  'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o',
+  'p', 'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z', '0', '1', '2', '3',
+  '4', '5', '6', '7', '8', '9', '+', '/'};
+
+signed char db64_table[256];
+
+
+void InitLegacyTables() {
+  for (unsigned i = 0; i < 256; ++i)
+    db64_table[i] = -1;
+  for (unsigned i = 0; i < 64; ++i)
+    db64_table[static_cast<unsigned char>(b64_table[i])] = i;
+  db64_table[static_cast<unsigned char>('=')] = 0;
+}
+
+
+string LegacyBase64(const string &data) {
+  string result;
+  result.reserve((data.length()+3)*4/3);
+  unsigned pos = 0;
+  const unsigned char *data_ptr =
+    reinterpret_cast<const unsigned char *>(data.data());
+  const unsigned length = data.length();
+  while (pos+2 < length) {
+    const unsigned char *input = data_ptr + pos;
+    char block[4];
+    block[0] = b64_table[input[0] >> 2];
+    block[1] = b64_table[((input[0] & 0x03) << 4) | (input[1] >> 4)];
+    block[2] = b64_table[((input[1] & 0x0F) << 2) | (input[2] >> 6)];
+    block[3] = b64_table[input[2] & 0x3F];
+    result.append(block, 4);
+    pos += 3;
+  }
+  if (length % 3 != 0) {
+    unsigned char input[3];
+    input[0] = data_ptr[pos];
+    input[1] = ((length % 3) == 2) ? data_ptr[pos+1] : 0;
+    input[2] = 0;
+    char block[4];
+    block[0] = b64_table[input[0] >> 2];
+    block[1] = b64_table[((input[0] & 0x03) << 4) | (input[1] >> 4)];
+    block[2] = b64_table[((input[1] & 0x0F) << 2) | (input[2] >> 6)];
+    result.append(block, 2);
+    result.push_back(((length % 3) == 2) ? block[2] : '=');
+    result.push_back('=');
+  }
+  return result;
+}
+
+
+string LegacyDebase64(const string &data) {
+  const unsigned char *data_ptr =
+    reinterpret_cast<const unsigned char *>(data.data());
+  const unsigned length = data.length();
+  if (length == 0)
+    return "";
+  assert((length % 4) == 0);
+
+  string result;
+  result.reserve((length + 4) * 3/4);
+  unsigned pos = 0;
+  while (pos < length) {
+    int32_t dec[4];
+    for (int i = 0; i < 4; ++i) {
+      dec[i] = db64_table[data_ptr[pos + i]];
+      assert(dec[i] >= 0);
+    }
+    unsigned char block[3];
+    block[0] = (dec[0] << 2) | (dec[1] >> 4);
+    block[1] = ((dec[1] & 0x0F) << 4) | (dec[2] >> 2);
+    block[2] = ((dec[2] & 0x03) << 6) | dec[3];
+    result.append(reinterpret_cast<char *>(block), 3);
+    pos += 4;
+  }
+  for (int i = 0; i < 2; ++i) {
+    pos--;
+    if (data[pos] == '=')
+      result.erase(result.length()-1);
+  }
+  return result;
+}
+
+
+double Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+string RandomData(unsigned size) {
+  string data(size, '\0');
+  for (unsigned i = 0; i < size; ++i)
+    data[i] = random() & 0xFF;
+  return data;
+}
+
+
+volatile size_t g_sink;
+
+/**
+ * Prints the throughput in MB/s of the raw input for each codec.
+ */
+void Benchmark(unsigned size) {
+  const string data = RandomData(size);
+  const string encoded = LegacyBase64(data);
+  string decoded;
+  if ((Base64(data) != encoded) || !Debase64(encoded, &decoded) ||
+      (decoded != data))
+  {
+    printf("MISMATCH for %u bytes\n", size);
+    exit(1);
+  }
+
+  const unsigned iterations = 200 * 1000 * 1000 / (size + 64);
+  const double mb = static_cast<double>(size) * iterations / (1024 * 1024);
+  double t0 = Now();
+  for (unsigned i = 0; i < iterations; ++i)
+    g_sink += LegacyBase64(data).size();
+  const double legacy_enc = mb / (Now() - t0);
+  t0 = Now();
+  for (unsigned i = 0; i < iterations; ++i)
+    g_sink += Base64(data).size();
+  const double enc = mb / (Now() - t0);
+  t0 = Now();
+  for (unsigned i = 0; i < iterations; ++i)
+    g_sink += LegacyDebase64(encoded).size();
+  const double legacy_dec = mb / (Now() - t0);
+  t0 = Now();
+  for (unsigned i = 0; i < iterations; ++i) {
+    Debase64(encoded, &decoded);
+    g_sink += decoded.size();
+  }
+  const double dec = mb / (Now() - t0);
+
+  printf("%8u %12.0f %12.0f %12.0f %12.0f\n",
+         size, legacy_enc, enc, legacy_dec, dec);
+}
+
+}  // anonymous namespace
+
+
+int main() {
+  InitLegacyTables();
+  printf("%8s %12s %12s %12s %12s   (MB/s)\n",
+         "bytes", "legacy enc", "enc", "legacy dec", "dec");
+  // Membership lists
+  Benchmark(32);
+  Benchmark(128);
+  Benchmark(512);
+  // Proxies with one to a few VOMS ACs
+  Benchmark(4 * 1024);
+  Benchmark(12 * 1024);
+  Benchmark(20 * 1024);
+  return 0;
+}
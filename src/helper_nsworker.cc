@@ -0,0 +1,356 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "helper_nsworker.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <climits>
+#include <cstdio>
+#include <cstring>
+
+#include "x509_helper_log.h"
+
+using namespace std;  // NOLINT
+
+NsWorkerPool *NsWorkerPool::g_ns_worker_pool = NULL;
+
+namespace {
+
+/**
+ * A worker that does not answer within this time is killed; it may be
+ * blocked on a FIFO or on an unresponsive file system.
+ */
+const int kRequestTimeoutMs = 10 * 1000;
+
+/**
+ * Closes everything inherited from the helper, in particular the pipes to
+ * cvmfs, except for the worker's socket and the debug log.
+ */
+void CloseInheritedFds(int keep_fd) {
+  FILE *fp_debug = GetLogAuthzDebugFile();
+  const int debug_fd = (fp_debug != NULL) ? fileno(fp_debug) : -1;
+  DIR *dirp = opendir("/proc/self/fd");
+  if (dirp == NULL)
+    _exit(1);
+  const int dir_fd = dirfd(dirp);
+  int fds[1024];
+  unsigned nfds = 0;
+  struct dirent *dent;
+  while (((dent = readdir(dirp)) != NULL) && (nfds < 1024)) {
+    if (dent->d_name[0] == '.')
+      continue;
+    const int fd = atoi(dent->d_name);
+    if ((fd != keep_fd) && (fd != debug_fd) && (fd != dir_fd) &&
+        (fd != STDERR_FILENO))
+    {
+      fds[nfds++] = fd;
+    }
+  }
+  closedir(dirp);
+  for (unsigned i = 0; i < nfds; ++i)
+    close(fds[i]);
+}
+
+
+/**
+ * Enters the user and then the mount namespace of pid.  As before with the
+ * per-request clone, a user namespace that cannot be entered is skipped and
+ * files are opened in the namespaces of the helper.  Returns false if the
+ * namespaces differ from the ones the worker is keyed by.
+ */
+bool EnterNamespaces(pid_t pid, ino_t user_ns, ino_t mnt_ns) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/ns/user", pid);
+  const int fd_user = open(path, O_RDONLY);
+  if (fd_user == -1) {
+    LogAuthz(kLogAuthzDebug, "could not open new user namespace %s", path);
+    return true;
+  }
+  struct stat info;
+  if ((fstat(fd_user, &info) != 0) || (info.st_ino != user_ns)) {
+    close(fd_user);
+    return false;
+  }
+  if (setns(fd_user, CLONE_NEWUSER) == -1) {
+    LogAuthz(kLogAuthzDebug, "could not switch to user namespace %s", path);
+    close(fd_user);
+    return true;
+  }
+  close(fd_user);
+
+  snprintf(path, sizeof(path), "/proc/%d/ns/mnt", pid);
+  const int fd_mnt = open(path, O_RDONLY);
+  if (fd_mnt == -1) {
+    LogAuthz(kLogAuthzDebug, "could not open new mnt namespace %s", path);
+    return false;
+  }
+  if ((fstat(fd_mnt, &info) != 0) || (info.st_ino != mnt_ns) ||
+      (setns(fd_mnt, CLONE_NEWNS) == -1))
+  {
+    LogAuthz(kLogAuthzDebug, "could not switch to mnt namespace %s", path);
+    close(fd_mnt);
+    return false;
+  }
+  close(fd_mnt);
+  LogAuthz(kLogAuthzDebug, "entered user and mnt namespace of %d", pid);
+  return true;
+}
+
+
+/**
+ * Serves open requests until the helper closes the socket or the worker
+ * was idle for a while.  Each reply carries the errno of the open(2) call
+ * and, on success, the file descriptor.
+ */
+void ServeRequests(int sock, int idle_timeout_ms) {
+  while (true) {
+    struct pollfd pfd;
+    pfd.fd = sock;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    const int retval = poll(&pfd, 1, idle_timeout_ms);
+    if ((retval < 0) && (errno == EINTR))
+      continue;
+    if (retval <= 0)
+      return;
+
+    char path[PATH_MAX];
+    const ssize_t nbytes = recv(sock, path, sizeof(path), 0);
+    if (nbytes <= 0)
+      return;
+    int fd = -1;
+    int error = ENAMETOOLONG;
+    if (static_cast<size_t>(nbytes) < sizeof(path)) {
+      path[nbytes] = '\0';
+      fd = open(path, O_RDONLY | O_CLOEXEC);
+      error = (fd < 0) ? errno : 0;
+    }
+
+    struct iovec iov;
+    iov.iov_base = &error;
+    iov.iov_len = sizeof(error);
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    char control[CMSG_SPACE(sizeof(int))];
+    if (fd >= 0) {
+      memset(control, 0, sizeof(control));
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+      struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+      cmsg->cmsg_level = SOL_SOCKET;
+      cmsg->cmsg_type = SCM_RIGHTS;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+      memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+    const ssize_t nsent = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    if (fd >= 0)
+      close(fd);
+    if (nsent < 0)
+      return;
+  }
+}
+
+}  // anonymous namespace
+
+
+bool NsWorkerPool::WorkerKey::operator <(const WorkerKey &other) const {
+  if (user_ns != other.user_ns) return user_ns < other.user_ns;
+  if (mnt_ns != other.mnt_ns) return mnt_ns < other.mnt_ns;
+  if (uid != other.uid) return uid < other.uid;
+  return gid < other.gid;
+}
+
+
+bool NsWorkerPool::Spawn(pid_t pid, const WorkerKey &key, Worker *worker) {
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) != 0) {
+    LogAuthz(kLogAuthzDebug, "could not create worker socket (%d)", errno);
+    return false;
+  }
+  // Don't let the child flush buffered log messages a second time
+  fflush(NULL);
+  const pid_t parent = getpid();
+  const pid_t child = fork();
+  if (child < 0) {
+    LogAuthz(kLogAuthzDebug, "could not fork namespace worker (%d)", errno);
+    close(fds[0]);
+    close(fds[1]);
+    return false;
+  }
+
+  if (child == 0) {
+    CloseInheritedFds(fds[1]);
+    // Keep running as root only if the helper was not root to begin with
+    if (((setgid(key.gid) != 0) || (setuid(key.uid) != 0)) &&
+        (geteuid() == 0))
+    {
+      _exit(1);
+    }
+    if (!EnterNamespaces(pid, key.user_ns, key.mnt_ns))
+      _exit(1);
+    // Changing credentials resets the parent death signal, so set it last
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    if (getppid() != parent)
+      _exit(0);
+    ServeRequests(fds[1], 2 * kIdleTimeout * 1000);
+    _exit(0);
+  }
+
+  close(fds[1]);
+  worker->pid = child;
+  worker->fd = fds[0];
+  LogAuthz(kLogAuthzDebug, "started namespace worker %d for uid %d",
+           child, key.uid);
+  return true;
+}
+
+
+void NsWorkerPool::Stop(WorkerMap::iterator it) {
+  close(it->second.fd);
+  kill(it->second.pid, SIGKILL);
+  while ((waitpid(it->second.pid, NULL, 0) < 0) && (errno == EINTR)) { }
+  m_workers.erase(it);
+}
+
+
+void NsWorkerPool::StopIdle() {
+  const time_t now = time(NULL);
+  WorkerMap::iterator it = m_workers.begin();
+  while (it != m_workers.end()) {
+    WorkerMap::iterator next = it;
+    ++next;
+    if (it->second.last_used + kIdleTimeout <= now)
+      Stop(it);
+    it = next;
+  }
+}
+
+
+/**
+ * Returns 0 and sets fd on success, otherwise the errno of the worker's
+ * open(2) call, or EPIPE/ETIMEDOUT if the worker is gone or stuck.
+ */
+int NsWorkerPool::Request(const Worker &worker, const char *path, int *fd) {
+  if (send(worker.fd, path, strlen(path), MSG_NOSIGNAL) < 0)
+    return EPIPE;
+
+  struct pollfd pfd;
+  pfd.fd = worker.fd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  int retval;
+  do {
+    retval = poll(&pfd, 1, kRequestTimeoutMs);
+  } while ((retval < 0) && (errno == EINTR));
+  if (retval == 0)
+    return ETIMEDOUT;
+  if (retval < 0)
+    return EPIPE;
+
+  int error;
+  struct iovec iov;
+  iov.iov_base = &error;
+  iov.iov_len = sizeof(error);
+  char control[CMSG_SPACE(sizeof(int))];
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  const ssize_t nbytes = recvmsg(worker.fd, &msg, MSG_CMSG_CLOEXEC);
+  if (nbytes != static_cast<ssize_t>(sizeof(error)))
+    return EPIPE;
+
+  *fd = -1;
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if ((cmsg != NULL) && (cmsg->cmsg_level == SOL_SOCKET) &&
+      (cmsg->cmsg_type == SCM_RIGHTS))
+  {
+    memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+  }
+  if (error == 0 && *fd < 0)
+    return EPIPE;
+  return error;
+}
+
+
+FILE *NsWorkerPool::Open(pid_t pid, uid_t uid, gid_t gid, const char *path) {
+  StopIdle();
+
+  WorkerKey key;
+  key.uid = uid;
+  key.gid = gid;
+  char ns_path[64];
+  struct stat info;
+  snprintf(ns_path, sizeof(ns_path), "/proc/%d/ns/user", pid);
+  if (stat(ns_path, &info) != 0)
+    return NULL;
+  key.user_ns = info.st_ino;
+  snprintf(ns_path, sizeof(ns_path), "/proc/%d/ns/mnt", pid);
+  if (stat(ns_path, &info) != 0)
+    return NULL;
+  key.mnt_ns = info.st_ino;
+
+  WorkerMap::iterator it = m_workers.find(key);
+  // A worker that exited on its own is replaced once
+  for (unsigned attempt = 0; attempt < 2; ++attempt) {
+    if (it == m_workers.end()) {
+      if (m_workers.size() >= kMaxWorkers) {
+        WorkerMap::iterator lru = m_workers.begin();
+        for (WorkerMap::iterator i = m_workers.begin(); i != m_workers.end();
+             ++i)
+        {
+          if (i->second.last_used < lru->second.last_used)
+            lru = i;
+        }
+        Stop(lru);
+      }
+      Worker worker;
+      if (!Spawn(pid, key, &worker)) {
+        errno = EAGAIN;
+        return NULL;
+      }
+      it = m_workers.insert(make_pair(key, worker)).first;
+    }
+    it->second.last_used = time(NULL);
+
+    int fd;
+    const int error = Request(it->second, path, &fd);
+    if (error == 0) {
+      FILE *fp = fdopen(fd, "r");
+      if (fp == NULL)
+        close(fd);
+      return fp;
+    }
+    if ((error != EPIPE) && (error != ETIMEDOUT)) {
+      errno = error;
+      return NULL;
+    }
+    LogAuthz(kLogAuthzDebug, "namespace worker %d failed (%d)",
+             it->second.pid, error);
+    Stop(it);
+    it = m_workers.end();
+    if (error == ETIMEDOUT) {
+      errno = error;
+      return NULL;
+    }
+  }
+  errno = EPIPE;
+  return NULL;
+}
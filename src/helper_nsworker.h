@@ -0,0 +1,75 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_AUTHZ_HELPER_NSWORKER_H_
+#define CVMFS_AUTHZ_HELPER_NSWORKER_H_
+
+#include <sys/types.h>
+#include <time.h>
+
+#include <cstdio>
+#include <map>
+
+/**
+ * Opens credential files inside the user and mount namespaces of requesting
+ * processes, for containers that cannot be entered with chroot (e.g.
+ * unprivileged user namespace containers).
+ *
+ * There is one long-lived worker process per user namespace, mount namespace,
+ * uid, and gid.  A worker enters its namespaces once, with the credentials of
+ * the user, and then opens files on request.  Paths are sent over a
+ * SOCK_SEQPACKET socketpair; the opened file descriptors are passed back with
+ * SCM_RIGHTS.  Workers that were idle for kIdleTimeout seconds are stopped.
+ */
+class NsWorkerPool {
+ public:
+  static NsWorkerPool *GetInstance() {
+    if (!g_ns_worker_pool)
+      g_ns_worker_pool = new NsWorkerPool();
+    return g_ns_worker_pool;
+  }
+
+  /**
+   * Opens path for reading as uid/gid in the namespaces of pid.  Must be
+   * called with effective uid 0.  Returns NULL and sets errno on failure.
+   */
+  FILE *Open(pid_t pid, uid_t uid, gid_t gid, const char *path);
+
+ private:
+  static const time_t kIdleTimeout = 60;
+  static const unsigned kMaxWorkers = 16;
+
+  struct WorkerKey {
+    WorkerKey() : user_ns(0), mnt_ns(0), uid(0), gid(0) {}
+    bool operator <(const WorkerKey &other) const;
+
+    ino_t user_ns;
+    ino_t mnt_ns;
+    uid_t uid;
+    gid_t gid;
+  };
+
+  struct Worker {
+    Worker() : pid(-1), fd(-1), last_used(0) {}
+    pid_t pid;
+    int fd;  ///< Parent end of the socketpair
+    time_t last_used;
+  };
+
+  typedef std::map<WorkerKey, Worker> WorkerMap;
+
+  NsWorkerPool() {}
+  NsWorkerPool(const NsWorkerPool&);
+
+  bool Spawn(pid_t pid, const WorkerKey &key, Worker *worker);
+  void Stop(WorkerMap::iterator it);
+  void StopIdle();
+  int Request(const Worker &worker, const char *path, int *fd);
+
+  WorkerMap m_workers;
+
+  static NsWorkerPool *g_ns_worker_pool;
+};
+
+#endif  // CVMFS_AUTHZ_HELPER_NSWORKER_H_
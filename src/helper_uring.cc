@@ -0,0 +1,297 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "helper_uring.h"
+
+#ifdef HAVE_IO_URING
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "helper_utils.h"
+#include "x509_helper_log.h"
+
+using namespace std;  // NOLINT
+
+ProcUring *ProcUring::g_proc_uring = NULL;
+
+namespace {
+
+enum FirstBatch {
+  kOpenEnviron = 0,
+  kOpenStat,
+  kStatRoot,
+  kStatMntNs,
+  kFirstBatchSize,
+};
+
+enum SecondBatch {
+  kReadEnviron = 0,
+  kCloseEnviron,
+  kReadStat,
+  kCloseStat,
+  kSecondBatchSize,
+};
+
+}  // anonymous namespace
+
+
+ProcUring::ProcUring()
+  : m_ring_fd(-1)
+  , m_sq_pending(0)
+  , m_sq_head(NULL)
+  , m_sq_tail(NULL)
+  , m_sq_mask(NULL)
+  , m_sq_array(NULL)
+  , m_sqes(NULL)
+  , m_cq_head(NULL)
+  , m_cq_tail(NULL)
+  , m_cq_mask(NULL)
+  , m_cqes(NULL)
+  , m_environ_buf(NULL)
+{
+  if (!Setup())
+    Disable();
+}
+
+
+bool ProcUring::Setup() {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  m_ring_fd = syscall(__NR_io_uring_setup, kRingSize, &params);
+  if (m_ring_fd < 0) {
+    LogAuthz(kLogAuthzDebug, "io_uring not available (%d)", errno);
+    return false;
+  }
+  // Kernels without a single mapping for both rings lack the operations
+  // used below anyway
+  if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+    LogAuthz(kLogAuthzDebug, "io_uring too old");
+    return false;
+  }
+
+  const size_t ring_size = max(
+    params.sq_off.array + params.sq_entries * sizeof(unsigned),
+    params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe));
+  void *ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQ_RING);
+  if (ring == MAP_FAILED)
+    return false;
+  void *sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe),
+                    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    m_ring_fd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED)
+    return false;
+  m_environ_buf = reinterpret_cast<char *>(malloc(kMaxEnvironSize + 1));
+  if (m_environ_buf == NULL)
+    return false;
+
+  char *base = reinterpret_cast<char *>(ring);
+  m_sq_head = reinterpret_cast<unsigned *>(base + params.sq_off.head);
+  m_sq_tail = reinterpret_cast<unsigned *>(base + params.sq_off.tail);
+  m_sq_mask = reinterpret_cast<unsigned *>(base + params.sq_off.ring_mask);
+  m_sq_array = reinterpret_cast<unsigned *>(base + params.sq_off.array);
+  m_sqes = reinterpret_cast<struct io_uring_sqe *>(sqes);
+  m_cq_head = reinterpret_cast<unsigned *>(base + params.cq_off.head);
+  m_cq_tail = reinterpret_cast<unsigned *>(base + params.cq_off.tail);
+  m_cq_mask = reinterpret_cast<unsigned *>(base + params.cq_off.ring_mask);
+  m_cqes = reinterpret_cast<struct io_uring_cqe *>(base + params.cq_off.cqes);
+  return true;
+}
+
+
+/**
+ * Falls back to the synchronous reads for good.  The mappings are kept; the
+ * helper process is short-lived compared to their cost.
+ */
+void ProcUring::Disable() {
+  if (m_ring_fd >= 0)
+    close(m_ring_fd);
+  m_ring_fd = -1;
+}
+
+
+struct io_uring_sqe *ProcUring::NextSqe() {
+  const unsigned index = (*m_sq_tail + m_sq_pending) & *m_sq_mask;
+  ++m_sq_pending;
+  struct io_uring_sqe *sqe = &m_sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  m_sq_array[index] = index;
+  return sqe;
+}
+
+
+/**
+ * Submits the prepared entries and waits for their completions.  The result
+ * of each completion is stored in results at its user_data.
+ */
+bool ProcUring::SubmitAndWait(unsigned nsubmit, __s32 *results,
+                              unsigned nresults)
+{
+  __atomic_store_n(m_sq_tail, *m_sq_tail + m_sq_pending, __ATOMIC_RELEASE);
+  m_sq_pending = 0;
+
+  unsigned to_submit = nsubmit;
+  unsigned ncompleted = 0;
+  while (ncompleted < nsubmit) {
+    const int retval = syscall(__NR_io_uring_enter, m_ring_fd, to_submit,
+                               nsubmit - ncompleted, IORING_ENTER_GETEVENTS,
+                               NULL, 0);
+    if (retval < 0) {
+      if (errno == EINTR)
+        continue;
+      LogAuthz(kLogAuthzDebug, "io_uring_enter failed (%d)", errno);
+      return false;
+    }
+    to_submit -= min(static_cast<unsigned>(retval), to_submit);
+
+    unsigned head = *m_cq_head;
+    const unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+      const struct io_uring_cqe *cqe = &m_cqes[head & *m_cq_mask];
+      if (cqe->user_data < nresults)
+        results[cqe->user_data] = cqe->res;
+      ++ncompleted;
+    }
+    __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+  }
+  return true;
+}
+
+
+bool ProcUring::Read(pid_t pid, ProcessSnapshot *snapshot) {
+  if (m_ring_fd < 0)
+    return false;
+
+  char environ_path[64];
+  char stat_path[64];
+  char root_path[64];
+  char mnt_ns_path[64];
+  snprintf(environ_path, sizeof(environ_path), "/proc/%d/environ", pid);
+  snprintf(stat_path, sizeof(stat_path), "/proc/%d/stat", pid);
+  snprintf(root_path, sizeof(root_path), "/proc/%d/root", pid);
+  snprintf(mnt_ns_path, sizeof(mnt_ns_path), "/proc/%d/ns/mnt", pid);
+  struct statx root_info;
+  struct statx mnt_ns_info;
+
+  struct io_uring_sqe *sqe = NextSqe();
+  sqe->opcode = IORING_OP_OPENAT;
+  sqe->fd = AT_FDCWD;
+  sqe->addr = reinterpret_cast<uintptr_t>(environ_path);
+  sqe->open_flags = O_RDONLY | O_CLOEXEC;
+  sqe->user_data = kOpenEnviron;
+  sqe = NextSqe();
+  sqe->opcode = IORING_OP_OPENAT;
+  sqe->fd = AT_FDCWD;
+  sqe->addr = reinterpret_cast<uintptr_t>(stat_path);
+  sqe->open_flags = O_RDONLY | O_CLOEXEC;
+  sqe->user_data = kOpenStat;
+  sqe = NextSqe();
+  sqe->opcode = IORING_OP_STATX;
+  sqe->fd = AT_FDCWD;
+  sqe->addr = reinterpret_cast<uintptr_t>(root_path);
+  sqe->len = STATX_INO;
+  sqe->off = reinterpret_cast<uintptr_t>(&root_info);
+  sqe->user_data = kStatRoot;
+  sqe = NextSqe();
+  sqe->opcode = IORING_OP_STATX;
+  sqe->fd = AT_FDCWD;
+  sqe->addr = reinterpret_cast<uintptr_t>(mnt_ns_path);
+  sqe->len = STATX_INO;
+  sqe->off = reinterpret_cast<uintptr_t>(&mnt_ns_info);
+  sqe->user_data = kStatMntNs;
+
+  __s32 first[kFirstBatchSize];
+  if (!SubmitAndWait(kFirstBatchSize, first, kFirstBatchSize)) {
+    Disable();
+    return false;
+  }
+  for (unsigned i = 0; i < kFirstBatchSize; ++i) {
+    // Operation not known to this kernel
+    if ((first[i] == -EINVAL) || (first[i] == -EOPNOTSUPP)) {
+      LogAuthz(kLogAuthzDebug, "io_uring lacks needed operations");
+      if (first[kOpenEnviron] >= 0) close(first[kOpenEnviron]);
+      if (first[kOpenStat] >= 0) close(first[kOpenStat]);
+      Disable();
+      return false;
+    }
+  }
+
+  // Each read is linked to the close of its file, which is canceled if the
+  // read fails
+  char stat_buf[1024];
+  __s32 second[kSecondBatchSize];
+  unsigned nsubmit = 0;
+  if (first[kOpenEnviron] >= 0) {
+    sqe = NextSqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = first[kOpenEnviron];
+    sqe->addr = reinterpret_cast<uintptr_t>(m_environ_buf);
+    sqe->len = kMaxEnvironSize;
+    sqe->flags = IOSQE_IO_LINK;
+    sqe->user_data = kReadEnviron;
+    sqe = NextSqe();
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = first[kOpenEnviron];
+    sqe->user_data = kCloseEnviron;
+    nsubmit += 2;
+  }
+  if (first[kOpenStat] >= 0) {
+    sqe = NextSqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = first[kOpenStat];
+    sqe->addr = reinterpret_cast<uintptr_t>(stat_buf);
+    sqe->len = sizeof(stat_buf) - 1;
+    sqe->flags = IOSQE_IO_LINK;
+    sqe->user_data = kReadStat;
+    sqe = NextSqe();
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = first[kOpenStat];
+    sqe->user_data = kCloseStat;
+    nsubmit += 2;
+  }
+  for (unsigned i = 0; i < kSecondBatchSize; ++i)
+    second[i] = -ECANCELED;
+  if ((nsubmit > 0) && !SubmitAndWait(nsubmit, second, kSecondBatchSize)) {
+    if (first[kOpenEnviron] >= 0) close(first[kOpenEnviron]);
+    if (first[kOpenStat] >= 0) close(first[kOpenStat]);
+    Disable();
+    return false;
+  }
+  if ((first[kOpenEnviron] >= 0) && (second[kCloseEnviron] == -ECANCELED))
+    close(first[kOpenEnviron]);
+  if ((first[kOpenStat] >= 0) && (second[kCloseStat] == -ECANCELED))
+    close(first[kOpenStat]);
+
+  snapshot->environ_content.clear();
+  if (second[kReadEnviron] > 0)
+    snapshot->environ_content.assign(m_environ_buf, second[kReadEnviron]);
+  snapshot->has_start_time = false;
+  if (second[kReadStat] > 0) {
+    stat_buf[second[kReadStat]] = '\0';
+    snapshot->has_start_time =
+      ParseProcessStartTime(stat_buf, &snapshot->start_time);
+  }
+  snapshot->has_container = (first[kStatRoot] == 0) &&
+                            (first[kStatMntNs] == 0);
+  if (snapshot->has_container) {
+    snapshot->container = FormatContainerIdentity(
+      makedev(root_info.stx_dev_major, root_info.stx_dev_minor),
+      root_info.stx_ino, mnt_ns_info.stx_ino);
+  }
+  return true;
+}
+
+#endif  // HAVE_IO_URING
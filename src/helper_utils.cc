@@ -7,16 +7,22 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 #include <unistd.h>
+#ifdef HAVE_OPENAT2
+#include <linux/openat2.h>
+#endif
 
 #include <cassert>
 #include <climits>
 #include <cstdio>
+#include <algorithm>
 #include <cstring>
 #include <vector>
-#include <sched.h>
-#include <wait.h>
 
+#include "helper_nsworker.h"
+#include "helper_uring.h"
 #include "x509_helper_log.h"
 
 using namespace std;  // NOLINT
@@ -26,193 +32,297 @@ static inline void ignore_result(int) {
 }
 
 /**
- * For a given pid, locates the env_name from the foreign process'
- * environment.  Returns the FILE pointer positioned after the '=' in
- * the environ file, or NULL if the environment variable is not found.
+ * Reads /proc/<pid>/environ with privileges, in large chunks and up to
+ * kMaxEnvironSize bytes.  Larger environments are truncated.
  */
- 
-static FILE *GetFileFromEnv(
-  const std::string &env_name,
-  const pid_t pid,
-  const size_t path_len,
-  char *path)
-{
-  assert(path_len > 0);
+bool ReadProcessEnviron(pid_t pid, string *content) {
+  const size_t kChunkSize = 64 * 1024;
 
-  if (snprintf(path, path_len, "/proc/%d/environ", pid) >=
-      static_cast<int>(path_len))
-  {
-    if (errno == 0) {errno = ERANGE;}
-    return NULL;
-  }
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/environ", pid);
   int olduid = geteuid();
   // NOTE: we ignore return values of these syscalls; this code path
   // will work if cvmfs is FUSE-mounted as an unprivileged user.
   ignore_result(seteuid(0));
-
-  FILE *env_file = fopen(path, "r");
+  const int fd = open(path, O_RDONLY);
   ignore_result(seteuid(olduid));
-  if (env_file == NULL) {
+  if (fd < 0) {
     LogAuthz(kLogAuthzSyslogErr | kLogAuthzDebug,
              "failed to open environment file for pid %d.", pid);
-    return NULL;
+    return false;
   }
 
-  string cur_str;
-  int c;
-  do {
-    // Search for the variable
-    cur_str = "";
-    do {
-      // Loop until find an equal sign
-      c = fgetc(env_file);
-      if (c == '=') {
-        if (cur_str == env_name) {
-          // Got a match
-          return env_file;
-        } else {
-          // Not this one, skip the value until the next null character
-          do {
-            c = fgetc(env_file);
-          } while ((c != EOF) && (c != '\0'));
+  size_t size = 0;
+  while (size < kMaxEnvironSize) {
+    if (content->size() < size + kChunkSize)
+      content->resize(min(size + kChunkSize, kMaxEnvironSize));
+    const ssize_t nbytes = read(fd, &(*content)[size], content->size() - size);
+    if (nbytes < 0) {
+      if (errno == EINTR)
+        continue;
+      LogAuthz(kLogAuthzDebug, "failed to read environment of pid %d (%d)",
+               pid, errno);
+      close(fd);
+      return false;
+    }
+    if (nbytes == 0)
+      break;
+    size += nbytes;
+  }
+  close(fd);
+  if (size == kMaxEnvironSize) {
+    LogAuthz(kLogAuthzDebug, "environment of pid %d truncated to %u bytes",
+             pid, static_cast<unsigned>(kMaxEnvironSize));
+  }
+  content->resize(size);
+  return true;
+}
+
+
+/**
+ * Collects the variables in names from the content of /proc/<pid>/environ
+ * in a single pass over the NUL separated entries.  As getenv(), the first
+ * definition of a variable wins.
+ */
+void ParseProcessEnvironment(const string &content,
+                             const vector<string> &names,
+                             ProcessEnvironment *env)
+{
+  env->values.clear();
+  const char *pos = content.data();
+  const char *end = pos + content.size();
+  unsigned nfound = 0;
+  while ((pos < end) && (nfound < names.size())) {
+    const char *entry_end =
+      reinterpret_cast<const char *>(memchr(pos, '\0', end - pos));
+    // A truncated last entry is ignored
+    if (entry_end == NULL)
+      break;
+    const size_t entry_len = entry_end - pos;
+    for (unsigned i = 0; i < names.size(); ++i) {
+      const string &name = names[i];
+      if ((entry_len > name.length()) && (pos[name.length()] == '=') &&
+          (memcmp(pos, name.data(), name.length()) == 0))
+      {
+        if (env->values.count(name) == 0) {
+          env->values[name] = string(pos + name.length() + 1,
+                                     entry_len - name.length() - 1);
+          ++nfound;
         }
-      } else if (c != EOF) {
-        // append the character to the variable name
-        cur_str.append(1, c);
+        break;
       }
-    } while ((c != EOF) && (c != '\0'));
-  } while (c != EOF);
+    }
+    pos = entry_end + 1;
+  }
+}
+
 
-  fclose(env_file);
-  return NULL;
+/**
+ * 64 bit FNV-1a; only used to detect changes of the environment of a known
+ * process.
+ */
+uint64_t HashEnviron(const string &content) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < content.size(); ++i) {
+    hash ^= static_cast<unsigned char>(content[i]);
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
 }
 
+
 /**
- * For a given pid, extracts the env_name path from the foreign process'
- * environment.  Stores the resulting path in the user provided buffer
- * path.
+ * The start time in clock ticks since boot, field 22 of the NUL terminated
+ * content of /proc/<pid>/stat.  Together with the pid it identifies a
+ * process across pid reuse.
  */
- 
-static bool GetPathFromEnv(
-  const std::string &env_name,
-  const pid_t pid,
-  const size_t path_len,
-  char *path)
-{
-  FILE *fp = GetFileFromEnv(env_name, pid, path_len, path);
-  if (fp == NULL) {
+bool ParseProcessStartTime(const char *stat, uint64_t *start_time) {
+  // The command name in parentheses may contain spaces and parentheses
+  const char *pos = strrchr(stat, ')');
+  if (pos == NULL)
     return false;
+  // Field 3 (state) follows; skip fields 3 to 21
+  for (unsigned field = 3; field <= 22; ++field) {
+    pos = strchr(pos, ' ');
+    if (pos == NULL)
+      return false;
+    ++pos;
   }
-  string str;
-  GetStringFromFile(fp, str);
-  fclose(fp);
-  strncpy(path, str.c_str(), path_len);
-  return true;
+  char *end;
+  *start_time = strtoull(pos, &end, 10);
+  return (end != pos);
 }
 
 
-/**
- * Gets a FILE pointer pointing to the value of an environment variable,
- * null terminated.  Returns NULL if the variable was not found.
- */ 
-FILE *GetEnvVarFile(const std::string &env_name, const pid_t pid)
-{
-  char path[PATH_MAX];
-  return GetFileFromEnv(env_name, pid, PATH_MAX, path);
+bool GetProcessStartTime(pid_t pid, uint64_t *start_time) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+  const int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+  char buf[1024];
+  ssize_t nbytes;
+  do {
+    nbytes = read(fd, buf, sizeof(buf) - 1);
+  } while ((nbytes < 0) && (errno == EINTR));
+  close(fd);
+  if (nbytes <= 0)
+    return false;
+  buf[nbytes] = '\0';
+  return ParseProcessStartTime(buf, start_time);
 }
 
-/* Parameters to GetFileInNs */
-struct getFileInNsParams {
-  pid_t pid;
-  uid_t uid;
-  gid_t gid;
-  char *env_path;
-  FILE *fp;
-};
 
 /**
- * Thread function for opening a file inside a user and mount namespace.
- * The passed in parameter is of type void * but is a reference to 
- * a structure of type getFileInNsParams.
- * Returns the open FILE object in the params.
- * Returns non-zero for error and 0 for success.
+ * Reads the environment and the start time of pid and, if io_uring is
+ * available, also its container identity, all in one batch.  Otherwise the
+ * container identity is left to GetContainerIdentity(), for cache misses.
  */
-static int GetFileInNs(void *t) {
-  struct getFileInNsParams *p = (struct getFileInNsParams *) t;
-
-  // Set real gid and uid in this thread, not just effective, else
-  // it interferes with the use of the unprivileged user namespace.
-  // NOTE: this is depending on the fact that CLONE_THREAD was not
-  // used because otherwise the setting is shared between threads. 
-  // See the setuid(2), clone(2), and nptl(7) man pages.
-  ignore_result(setgid(p->gid));
-  ignore_result(setuid(p->uid));
-
-  char path[PATH_MAX];
-  if (snprintf(path, PATH_MAX, "/proc/%d/ns/user", p->pid) >= PATH_MAX) {
-    if (errno == 0) {errno = ERANGE;}
-    return errno;
-  }
-  int fd1 = open(path, O_RDONLY);
-  int fd2 = -1;
-  if (-1 == fd1) {
-    // Couldn't open new user namespace, see if it works without
-    LogAuthz(kLogAuthzDebug, "could not open new user namespace %s", path);
-  } else if (-1 == setns(fd1, CLONE_NEWUSER)) {
-    // Couldn't switch to new user namespace, try without
-    close(fd1);
-    fd1 = -1;
-    LogAuthz(kLogAuthzDebug, "could not switch to user namespace %s", path);
-  } else {
-    if (snprintf(path, PATH_MAX, "/proc/%d/ns/mnt", p->pid) >= PATH_MAX) {
-      if (errno == 0) {errno = ERANGE;}
-      return errno;
-    }
-    fd2 = open(path, O_RDONLY);
-    int saveerrno = errno;
-    if (-1 == fd2) {
-      LogAuthz(kLogAuthzDebug, "could not open new mnt namespace %s", path);
-      // Very strange that couldn't open new mnt namespace when user
-      // namespace worked.  Just return an error.
-      close(fd1);
-      return saveerrno;
-    } else if (-1 == setns(fd2, CLONE_NEWNS)) {
-      saveerrno = errno;
-      // Likewise strange that couldn't switch to new mnt namespace
-      LogAuthz(kLogAuthzDebug, "could not switch to mnt namespace %s", path);
-      close(fd1);
-      close(fd2);
-      return saveerrno;
-    }
-    LogAuthz(kLogAuthzDebug, "entered user and mnt namespace of %d", p->pid);
-  }
-  p->fp = fopen(p->env_path, "r");
-  if (fd1 != -1) close(fd1);
-  if (fd2 != -1) close(fd2);
-  return 0;
+void ReadProcessSnapshot(pid_t pid, ProcessSnapshot *snapshot) {
+#ifdef HAVE_IO_URING
+  int olduid = geteuid();
+  ignore_result(seteuid(0));
+  const bool batched = ProcUring::GetInstance()->Read(pid, snapshot);
+  ignore_result(seteuid(olduid));
+  if (batched)
+    return;
+#endif
+  ReadProcessEnviron(pid, &snapshot->environ_content);
+  snapshot->has_start_time = GetProcessStartTime(pid, &snapshot->start_time);
+  snapshot->has_container = false;
+}
+
+
+bool ProcessEnvironment::Get(const string &name, string *value) const {
+  map<string, string>::const_iterator it = values.find(name);
+  if (it == values.end())
+    return false;
+  *value = it->second;
+  return true;
 }
 
 /**
- * Opens a read-only file pointer to the proxy certificate as a given user.
- * The path is either taken from X509_USER_PROXY environment from the given pid
- * or it is the default location /tmp/x509up_u<UID>
+ * Resolves the path of a credential file from the env_name variable in the
+ * environment of the requesting process, falling back to default_path if it
+ * is not empty.  The default location of the proxy is /tmp/x509up_u<UID>.
  */
-FILE *GetFile(const std::string &env_name, pid_t pid, uid_t uid, gid_t gid, const std::string &default_path)
+bool GetFilePath(const ProcessEnvironment &env, const std::string &env_name, const std::string &default_path, std::string *path)
 {
-  char env_path[PATH_MAX];
-  if (!GetPathFromEnv(env_name, pid, PATH_MAX, env_path)) {
+  string env_path;
+  if (!env.Get(env_name, &env_path)) {
     
     // If there is a default path, use that
     if (default_path.size()) {
       LogAuthz(kLogAuthzDebug, "could not find %s in environment, trying default location of %s", env_name.c_str(), default_path.c_str());
-      strncpy(env_path, default_path.c_str(), PATH_MAX);
+      *path = default_path;
     } else {
       LogAuthz(kLogAuthzDebug, "could not find %s in environment", env_name.c_str());
-      return NULL;
+      return false;
     }
   }
-  else
-      LogAuthz(kLogAuthzDebug, "looking in %s from %s", env_path, env_name.c_str());
+  else {
+      if (env_path.size() >= PATH_MAX) {
+        LogAuthz(kLogAuthzDebug, "%s exceeds PATH_MAX", env_name.c_str());
+        return false;
+      }
+      LogAuthz(kLogAuthzDebug, "looking in %s from %s", env_path.c_str(), env_name.c_str());
+      *path = env_path;
+  }
+  return true;
+}
+
+#if defined(HAVE_OPENAT2) && defined(SYS_openat2)
+/**
+ * Cleared once the kernel turns out not to support openat2 or its resolve
+ * flags.
+ */
+static bool g_openat2_supported = true;
+
+/**
+ * The user namespace of the helper, to recognize processes that are not
+ * inside an unprivileged container.
+ */
+static bool GetUserNamespace(pid_t pid, ino_t *ns) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/ns/user", pid);
+  struct stat info;
+  if (stat(path, &info) != 0)
+    return false;
+  *ns = info.st_ino;
+  return true;
+}
+
+/**
+ * Opens an absolute path with openat2(RESOLVE_IN_ROOT) relative to the root
+ * directory of pid, which resolves it as chroot would, without changing the
+ * root directory and working directory of the helper.  This is only done
+ * for processes in the user namespace of the helper; others may need their
+ * namespaces to be entered (see NsWorkerPool).  Returns false if the caller
+ * has to use the chroot sequence instead.  Must be called with effective
+ * uid 0.
+ */
+static bool OpenFileInRoot(const char *path, pid_t pid, uid_t uid, gid_t gid,
+                           FILE **fp)
+{
+  static ino_t self_user_ns = 0;
+  if (!g_openat2_supported || (path[0] != '/'))
+    return false;
+  if ((self_user_ns == 0) && !GetUserNamespace(getpid(), &self_user_ns))
+    return false;
+  ino_t user_ns;
+  if (!GetUserNamespace(pid, &user_ns) || (user_ns != self_user_ns))
+    return false;
+
+  char root_path[64];
+  snprintf(root_path, sizeof(root_path), "/proc/%d/root", pid);
+  const int root_fd = open(root_path, O_PATH | O_DIRECTORY | O_CLOEXEC);
+  if (root_fd < 0)
+    return false;
+
+  struct open_how how;
+  memset(&how, 0, sizeof(how));
+  how.flags = O_RDONLY | O_CLOEXEC;
+  how.resolve = RESOLVE_IN_ROOT | RESOLVE_NO_MAGICLINKS;
+  int oldgid = getegid();
+  ignore_result(setegid(gid));
+  ignore_result(seteuid(uid));
+  const int fd = syscall(SYS_openat2, root_fd, path, &how, sizeof(how));
+  const int saved_errno = errno;
+  ignore_result(seteuid(0));
+  ignore_result(setegid(oldgid));
+  close(root_fd);
+
+  if (fd < 0) {
+    if ((saved_errno == ENOSYS) || (saved_errno == E2BIG) ||
+        (saved_errno == EINVAL))
+    {
+      LogAuthz(kLogAuthzDebug, "openat2 not supported (%d)", saved_errno);
+      g_openat2_supported = false;
+      return false;
+    }
+    *fp = NULL;
+    errno = saved_errno;
+    return true;
+  }
+  *fp = fdopen(fd, "r");
+  if (*fp == NULL)
+    close(fd);
+  return true;
+}
+#endif
+
+/**
+ * Opens path with the credentials of uid/gid, as seen from the root
+ * directory or the namespaces of pid.
+ */
+FILE *OpenFileAs(const std::string &path, pid_t pid, uid_t uid, gid_t gid)
+{
+  if (path.size() >= PATH_MAX) {
+    errno = ERANGE;
+    return NULL;
+  }
+  char env_path[PATH_MAX];
+  strncpy(env_path, path.c_str(), PATH_MAX);
 
   /**
    * If the target process is running inside a container, then we must
@@ -237,6 +347,16 @@ FILE *GetFile(const std::string &env_name, pid_t pid, uid_t uid, gid_t gid, cons
   // to change the UID and GID.
   ignore_result(seteuid(0));
 
+#if defined(HAVE_OPENAT2) && defined(SYS_openat2)
+  FILE *fp_in_root;
+  if (OpenFileInRoot(env_path, pid, uid, gid, &fp_in_root)) {
+    LogAuthz(kLogAuthzDebug, "resolved %s in root directory of %d",
+             env_path, pid);
+    ignore_result(seteuid(olduid));
+    return fp_in_root;
+  }
+#endif
+
   int fd1 = open("/", O_RDONLY); // Open FD to old root directory.
   int fd2 = open(".", O_RDONLY); // Open FD to old $CWD
   if ((fd1 == -1) || (fd2 == -1)) {
@@ -266,33 +386,9 @@ FILE *GetFile(const std::string &env_name, pid_t pid, uid_t uid, gid_t gid, cons
   if (!can_chroot) {
     // Couldn't chroot, which can happen at least starting in RHEL8 when
     // trying to chroot to an unprivileged user namespace as root.
-    // Instead, create a thread to try to enter user and mount namespaces
-    // as the user.  That has to be done in a thread in order to be able
-    // to return to the previous namespace.
-    struct getFileInNsParams params;
-    params.pid = pid;
-    params.uid = uid;
-    params.gid = gid;
-    params.env_path = env_path;
-    params.fp = NULL;
-    char stack[128 * 1024];
-
-    pid_t cpid = clone(GetFileInNs, stack + sizeof(stack),
-                        CLONE_VM | CLONE_FILES | SIGCHLD, (void *)&params);
-    if (cpid == -1) {
-      LogAuthz(kLogAuthzDebug, "could not clone thread");
-      abort();
-    }
-    int status = 0;
-    if (waitpid(cpid, &status, 0) == -1) {
-      LogAuthz(kLogAuthzDebug, "could not wait for cloned thread");
-      abort();
-    }
-    if (status != 0) {
-      LogAuthz(kLogAuthzDebug, "clone returned an error: %d", status);
-      abort();
-    }
-    fp = params.fp;
+    // Instead, let a worker process that entered the user and mount
+    // namespaces as the user open the file.
+    fp = NsWorkerPool::GetInstance()->Open(pid, uid, gid, env_path);
   } else {
     ignore_result(setegid(gid));
     ignore_result(seteuid(uid));
@@ -346,3 +442,108 @@ void GetStringFromFile(FILE *fp, string &str) {
   }
 }
 
+
+bool FileIdentity::operator <(const FileIdentity &other) const {
+  if (dev != other.dev) return dev < other.dev;
+  if (ino != other.ino) return ino < other.ino;
+  if (size != other.size) return size < other.size;
+  if (mtime.tv_sec != other.mtime.tv_sec)
+    return mtime.tv_sec < other.mtime.tv_sec;
+  if (mtime.tv_nsec != other.mtime.tv_nsec)
+    return mtime.tv_nsec < other.mtime.tv_nsec;
+  if (ctime.tv_sec != other.ctime.tv_sec)
+    return ctime.tv_sec < other.ctime.tv_sec;
+  return ctime.tv_nsec < other.ctime.tv_nsec;
+}
+
+
+bool FileIdentity::operator ==(const FileIdentity &other) const {
+  return !(*this < other) && !(other < *this);
+}
+
+
+/**
+ * Fills in the identity of an opened credential file.  Only regular files
+ * have a meaningful identity; returns false for anything else.
+ */
+bool GetFileIdentity(FILE *fp, FileIdentity *identity) {
+  struct stat info;
+  if (fstat(fileno(fp), &info) != 0) {
+    LogAuthz(kLogAuthzDebug, "failed to stat credential file (%d)", errno);
+    return false;
+  }
+  if (!S_ISREG(info.st_mode))
+    return false;
+  identity->dev = info.st_dev;
+  identity->ino = info.st_ino;
+  identity->size = info.st_size;
+  identity->mtime = info.st_mtim;
+  identity->ctime = info.st_ctim;
+  return true;
+}
+
+
+/**
+ * Identifies the file system view of pid (its root directory and mount
+ * namespace) so that equal paths from different containers are told apart.
+ */
+bool GetContainerIdentity(pid_t pid, std::string *identity) {
+  char root_path[64];
+  char ns_path[64];
+  snprintf(root_path, sizeof(root_path), "/proc/%d/root", pid);
+  snprintf(ns_path, sizeof(ns_path), "/proc/%d/ns/mnt", pid);
+
+  int olduid = geteuid();
+  ignore_result(seteuid(0));
+  struct stat root_info;
+  struct stat ns_info;
+  const bool retval = (stat(root_path, &root_info) == 0) &&
+                      (stat(ns_path, &ns_info) == 0);
+  ignore_result(seteuid(olduid));
+  if (!retval) {
+    LogAuthz(kLogAuthzDebug, "failed to identify container of pid %d", pid);
+    return false;
+  }
+
+  *identity = FormatContainerIdentity(root_info.st_dev, root_info.st_ino,
+                                      ns_info.st_ino);
+  return true;
+}
+
+
+string FormatContainerIdentity(dev_t root_dev, ino_t root_ino, ino_t ns_ino) {
+  char buf[128];
+  snprintf(buf, sizeof(buf), "%lu:%lu:%lu",
+           static_cast<unsigned long>(root_dev),  // NOLINT
+           static_cast<unsigned long>(root_ino),  // NOLINT
+           static_cast<unsigned long>(ns_ino));   // NOLINT
+  return buf;
+}
+
+/**
+ * Stats path as seen by pid, without entering its root directory or
+ * namespaces.  Symbolic links may resolve differently than for pid itself,
+ * so the result must only be compared against a known identity.
+ */
+bool GetFileIdentityAt(pid_t pid, const std::string &path,
+                       FileIdentity *identity)
+{
+  char prefix[64];
+  snprintf(prefix, sizeof(prefix), "/proc/%d/%s", pid,
+           (!path.empty() && path[0] == '/') ? "root" : "cwd/");
+  const string full_path = string(prefix) + path;
+
+  int olduid = geteuid();
+  ignore_result(seteuid(0));
+  struct stat info;
+  const int retval = stat(full_path.c_str(), &info);
+  ignore_result(seteuid(olduid));
+  if ((retval != 0) || !S_ISREG(info.st_mode))
+    return false;
+  identity->dev = info.st_dev;
+  identity->ino = info.st_ino;
+  identity->size = info.st_size;
+  identity->mtime = info.st_mtim;
+  identity->ctime = info.st_ctim;
+  return true;
+}
@@ -5,13 +5,101 @@
 #ifndef CVMFS_AUTHZ_HELPER_UTILS_H_
 #define CVMFS_AUTHZ_HELPER_UTILS_H_
 
+#include <stdint.h>
 #include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
+
+#include <cstdio>
+#include <map>
 #include <string>
+#include <vector>
+
+/**
+ * Identifies a version of a credential file without reading it.  A rewritten
+ * file changes at least its modification and change time.
+ */
+struct FileIdentity {
+  FileIdentity() : dev(0), ino(0), size(0) {
+    mtime.tv_sec = mtime.tv_nsec = 0;
+    ctime.tv_sec = ctime.tv_nsec = 0;
+  }
+  bool operator <(const FileIdentity &other) const;
+  bool operator ==(const FileIdentity &other) const;
+
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  struct timespec mtime;
+  struct timespec ctime;
+};
+
+/**
+ * The variables of interest from the environment of the requesting process.
+ */
+struct ProcessEnvironment {
+  bool Get(const std::string &name, std::string *value) const;
+
+  std::map<std::string, std::string> values;
+};
+
+/**
+ * What the credential fetchers need to know about the requesting process.
+ * It is cached by pid and start time (see ProcessCache).
+ */
+struct ProcessInfo {
+  ProcessInfo() : uid(-1), gid(-1), environ_hash(0), expiry(0) { }
+
+  // "<pid>:<start time>", empty if the process could not be identified
+  std::string key;
+  uid_t uid;
+  gid_t gid;
+  uint64_t environ_hash;
+  time_t expiry;
+  ProcessEnvironment env;
+  // See GetContainerIdentity(), empty if unknown
+  std::string container;
+  // Credential files that were opened on behalf of the process, by path
+  std::map<std::string, FileIdentity> opened;
+};
+
+/**
+ * Larger environments of requesting processes are truncated.
+ */
+const size_t kMaxEnvironSize = 4 * 1024 * 1024;
+
+/**
+ * What is read from /proc/<pid> on every request.
+ */
+struct ProcessSnapshot {
+  ProcessSnapshot() : has_start_time(false), start_time(0),
+                      has_container(false) { }
 
+  std::string environ_content;
+  bool has_start_time;
+  uint64_t start_time;
+  bool has_container;
+  std::string container;
+};
 
-FILE *GetFile(const std::string &env_name, const pid_t pid, const uid_t uid, const gid_t gid, const std::string &default_path);
-FILE *GetEnvVarFile(const std::string &env_name, const pid_t pid);
+void ReadProcessSnapshot(pid_t pid, ProcessSnapshot *snapshot);
+bool ReadProcessEnviron(pid_t pid, std::string *content);
+void ParseProcessEnvironment(const std::string &content,
+                             const std::vector<std::string> &names,
+                             ProcessEnvironment *env);
+uint64_t HashEnviron(const std::string &content);
+bool ParseProcessStartTime(const char *stat, uint64_t *start_time);
+bool GetProcessStartTime(pid_t pid, uint64_t *start_time);
+bool GetFileIdentity(FILE *fp, FileIdentity *identity);
+bool GetFilePath(const ProcessEnvironment &env, const std::string &env_name,
+                 const std::string &default_path, std::string *path);
+FILE *OpenFileAs(const std::string &path, pid_t pid, uid_t uid, gid_t gid);
+bool GetContainerIdentity(pid_t pid, std::string *identity);
+std::string FormatContainerIdentity(dev_t root_dev, ino_t root_ino,
+                                    ino_t ns_ino);
+bool GetFileIdentityAt(pid_t pid, const std::string &path,
+                       FileIdentity *identity);
 void GetStringFromFile(FILE *fp, std::string &str);
 
 #endif // CVMFS_AUTHZ_HELPER_UTILS_H_
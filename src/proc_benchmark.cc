@@ -0,0 +1,133 @@
+/**
+ * This file is part of the CernVM File System.
+ *
+ * Compares resolving a requesting process (environment, start time, and
+ * container identity) with the synchronous /proc reads against the io_uring
+ * batch.  Reports the latency and the number of syscalls per resolution;
+ * syscalls are counted by tracing a child with PTRACE_SYSCALL.  Built with
+ * -DBUILD_BENCHMARKS=ON, not installed.  Run as root to match the helper.
+ */
+
+#include <signal.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "helper_uring.h"
+#include "helper_utils.h"
+
+using namespace std;  // NOLINT
+
+namespace {
+
+typedef bool (*Resolver)(pid_t pid);
+
+volatile size_t g_sink;
+
+bool ResolveSync(pid_t pid) {
+  ProcessSnapshot snapshot;
+  ReadProcessEnviron(pid, &snapshot.environ_content);
+  snapshot.has_start_time = GetProcessStartTime(pid, &snapshot.start_time);
+  snapshot.has_container = GetContainerIdentity(pid, &snapshot.container);
+  g_sink += snapshot.environ_content.size() + snapshot.container.size();
+  return snapshot.has_start_time && snapshot.has_container;
+}
+
+#ifdef HAVE_IO_URING
+bool ResolveBatched(pid_t pid) {
+  ProcessSnapshot snapshot;
+  if (!ProcUring::GetInstance()->Read(pid, &snapshot))
+    return false;
+  g_sink += snapshot.environ_content.size() + snapshot.container.size();
+  return snapshot.has_start_time && snapshot.has_container;
+}
+#endif
+
+
+double Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/**
+ * Runs resolver iterations times in a traced child, after one untraced
+ * warm-up call, and returns the syscalls per call.
+ */
+double CountSyscalls(Resolver resolver, pid_t target, unsigned iterations) {
+  const pid_t child = fork();
+  if (child == 0) {
+    resolver(target);
+    ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+    raise(SIGSTOP);
+    for (unsigned i = 0; i < iterations; ++i)
+      resolver(target);
+    _exit(0);
+  }
+  int status;
+  waitpid(child, &status, 0);
+  ptrace(PTRACE_SETOPTIONS, child, NULL, PTRACE_O_TRACESYSGOOD);
+  unsigned stops = 0;
+  while (true) {
+    if (ptrace(PTRACE_SYSCALL, child, NULL, NULL) != 0)
+      return -1;
+    waitpid(child, &status, 0);
+    if (WIFEXITED(status))
+      break;
+    if (WIFSTOPPED(status) && (WSTOPSIG(status) == (SIGTRAP | 0x80)))
+      ++stops;
+  }
+  // Entry and exit stops; exit_group() has no exit stop
+  return static_cast<double>((stops - 1) / 2) / iterations;
+}
+
+
+void Benchmark(const char *name, Resolver resolver, pid_t target) {
+  if (!resolver(target)) {
+    printf("%-10s unavailable\n", name);
+    return;
+  }
+  const unsigned iterations = 20000;
+  const double t0 = Now();
+  for (unsigned i = 0; i < iterations; ++i)
+    resolver(target);
+  const double latency = (Now() - t0) / iterations * 1e6;
+  printf("%-10s %12.2f %12.1f\n", name, latency,
+         CountSyscalls(resolver, target, 100));
+}
+
+}  // anonymous namespace
+
+
+int main(int argc, char **argv) {
+  pid_t target;
+  if (argc > 1) {
+    target = atoi(argv[1]);
+  } else {
+    target = fork();
+    if (target == 0) {
+      pause();
+      _exit(0);
+    }
+  }
+
+  printf("%-10s %12s %12s\n", "resolver", "us/request", "syscalls");
+  Benchmark("sync", ResolveSync, target);
+#ifdef HAVE_IO_URING
+  Benchmark("io_uring", ResolveBatched, target);
+#else
+  printf("%-10s not compiled in\n", "io_uring");
+#endif
+
+  if (argc <= 1) {
+    kill(target, SIGKILL);
+    waitpid(target, NULL, 0);
+  }
+  return 0;
+}
@@ -16,51 +16,102 @@
 #include <string>
 #include <sstream>
 
+#include "x509_helper_cache.h"
+#include "x509_helper_digest.h"
 #include "x509_helper_log.h"
 #include "helper_utils.h"
 
 using namespace std;  // NOLINT
 
-FILE *GetSciToken(
-const AuthzRequest &authz_req, string *token, const string &var_name) {
+namespace {
+CredentialFileCache token_files(64);
+}
+
+FILE *GetSciToken(const AuthzRequest &authz_req, const ProcessInfo &info,
+                  string *token, const string &var_name)
+{
   assert(token != NULL);
 
+  const ProcessEnvironment &env = info.env;
   string env_name = var_name;
 
-  FILE *ftoken = GetEnvVarFile("BEARER_TOKEN", authz_req.pid);
-  if (ftoken != NULL) {
+  string env_token;
+  if (env.Get("BEARER_TOKEN", &env_token)) {
     LogAuthz(kLogAuthzDebug, "found token in $BEARER_TOKEN");
-  } 
-  else {
-    stringstream default_path;
-    FILE *fruntimedir = GetEnvVarFile("XDG_RUNTIME_DIR", authz_req.pid);
-    string runtimedir;
-    if (fruntimedir != NULL) {
-      GetStringFromFile(fruntimedir, runtimedir);
-      fclose(fruntimedir);
-    }
-    if (runtimedir.size()) {
-      default_path << runtimedir;
-    }
-    else {
-      default_path << "/tmp";
-    }
-    default_path << "/bt_u" << authz_req.uid;
-    string default_path_str = default_path.str();
-    if (default_path_str.size() > PATH_MAX) {
-      LogAuthz(kLogAuthzDebug, "default path string bigger than PATH_MAX, ignoring it");
-      default_path_str = "";
+    // Tokens from the environment have no file identity.  As before, a set
+    // but empty $BEARER_TOKEN is the (empty) token; fmemopen() needs a
+    // non-zero buffer size.
+    *token = env_token.substr(0, env_token.find('\n'));
+    FILE *ftoken = fmemopen(NULL, env_token.size() + 1, "w+");
+    if (ftoken == NULL)
+      return NULL;
+    if ((fwrite(env_token.data(), 1, env_token.size(), ftoken) !=
+         env_token.size()) || (fseek(ftoken, 0, SEEK_SET) != 0))
+    {
+      fclose(ftoken);
+      return NULL;
     }
+    return ftoken;
+  }
+
+  stringstream default_path;
+  string runtimedir;
+  env.Get("XDG_RUNTIME_DIR", &runtimedir);
+  if (runtimedir.size()) {
+    default_path << runtimedir;
+  }
+  else {
+    default_path << "/tmp";
+  }
+  default_path << "/bt_u" << authz_req.uid;
+  string default_path_str = default_path.str();
+  if (default_path_str.size() > PATH_MAX) {
+    LogAuthz(kLogAuthzDebug, "default path string bigger than PATH_MAX, ignoring it");
+    default_path_str = "";
+  }
 
-    ftoken =
-      GetFile(env_name.c_str(), authz_req.pid, authz_req.uid, authz_req.gid, default_path_str);
-    if (ftoken == NULL) {
-      LogAuthz(kLogAuthzDebug, "no token found for %s",
+  string path;
+  if (!GetFilePath(env, env_name, default_path_str, &path)) {
+    LogAuthz(kLogAuthzDebug, "no token found for %s",
+             authz_req.Ident().c_str());
+    return NULL;
+  }
+
+  // Users without tokens would otherwise pay for the namespace switch on
+  // every request
+  string key;
+  if (!info.container.empty()) {
+    stringstream key_stream;
+    key_stream << "token:" << info.container << ":" << authz_req.uid << ":"
+               << path;
+    key = key_stream.str();
+    if (NegativeCache::GetInstance()->IsNotFound(key)) {
+      LogAuthz(kLogAuthzDebug, "token recently not found for %s",
                authz_req.Ident().c_str());
       return NULL;
     }
   }
 
+  FILE *ftoken = OpenFileAs(path, authz_req.pid, authz_req.uid, authz_req.gid);
+  if (ftoken == NULL) {
+    LogAuthz(kLogAuthzDebug, "no token found for %s",
+             authz_req.Ident().c_str());
+    if (!key.empty())
+      NegativeCache::GetInstance()->InsertNotFound(key);
+    return NULL;
+  }
+
+  FileIdentity identity;
+  const bool has_identity = GetFileIdentity(ftoken, &identity);
+  if (has_identity) {
+    const CachedCredential *cached = token_files.Lookup(identity);
+    if (cached != NULL) {
+      LogAuthz(kLogAuthzDebug, "token file unchanged, skip reading it");
+      *token = cached->content;
+      return ftoken;
+    }
+  }
+
   long pos;
   if ((pos = ftell(ftoken)) == -1) {
       LogAuthz(kLogAuthzDebug | kLogAuthzSyslog | kLogAuthzSyslogErr, "Failure getting the ftoken position");
@@ -89,6 +140,12 @@ const AuthzRequest &authz_req, string *token, const string &var_name) {
   }
 
   LogAuthz(kLogAuthzDebug, "token is %s", token->c_str());
+  if (has_identity) {
+    CachedCredential credential;
+    credential.content = *token;
+    credential.fingerprint = Sha256(*token);
+    token_files.Insert(identity, credential);
+  }
 
   if (fseek(ftoken, pos, SEEK_SET) == -1) {
       LogAuthz(kLogAuthzDebug | kLogAuthzSyslog | kLogAuthzSyslogErr, "Failure setting the ftoken position");
@@ -10,9 +10,14 @@
 #include <cstdio>
 #include <string>
 
+#include "helper_utils.h"
 #include "x509_helper_req.h"
 
-FILE *GetSciToken(const AuthzRequest &authz_req, std::string *proxy, const std::string &env_name);
+/**
+ * info.env needs BEARER_TOKEN, XDG_RUNTIME_DIR and env_name.
+ */
+FILE *GetSciToken(const AuthzRequest &authz_req, const ProcessInfo &info,
+                  std::string *token, const std::string &env_name);
 
 #endif  // CVMFS_AUTHZ_SCITOKEN_HELPER_FETCH_H_
 
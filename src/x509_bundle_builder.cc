@@ -0,0 +1,64 @@
+/**
+ * This file is part of the CernVM File System.
+ *
+ * Compiles a trusted certificates directory into a trust bundle that the
+ * helpers map into memory (see x509_helper_bundle.h).  Meant to run after
+ * every update of the directory, e.g. after fetch-crl.
+ */
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "x509_helper_bundle.h"
+#include "x509_helper_log.h"
+
+using namespace std;  // NOLINT
+
+
+static void Usage(const char *progname) {
+  fprintf(stderr,
+          "Usage: %s [-c <certificates directory>] [-v] <bundle>\n"
+          "  -c  directory to compile, defaults to $X509_CERT_DIR or\n"
+          "      /etc/grid-security/certificates\n"
+          "  -v  verbose output\n", progname);
+}
+
+
+int main(int argc, char **argv) {
+  const char *env_cert_dir = getenv("X509_CERT_DIR");
+  string cert_dir =
+    env_cert_dir ? env_cert_dir : "/etc/grid-security/certificates";
+
+  int c;
+  while ((c = getopt(argc, argv, "c:vh")) != -1) {
+    switch (c) {
+      case 'c':
+        cert_dir = optarg;
+        break;
+      case 'v':
+        SetLogAuthzDebugFile(stderr);
+        break;
+      case 'h':
+        Usage(argv[0]);
+        return 0;
+      default:
+        Usage(argv[0]);
+        return 1;
+    }
+  }
+  if (optind != argc - 1) {
+    Usage(argv[0]);
+    return 1;
+  }
+
+  const string bundle_path = argv[optind];
+  if (!WriteTrustBundle(cert_dir, bundle_path)) {
+    fprintf(stderr, "failed to compile %s into %s\n",
+            cert_dir.c_str(), bundle_path.c_str());
+    return 1;
+  }
+  return 0;
+}
@@ -7,6 +7,8 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <pthread.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <libgen.h>
 
@@ -15,13 +17,20 @@
 #include <cstdlib>
 #include <cstring>
 #include <string>
+#include <vector>
 
+#include "helper_utils.h"
 #include "x509_helper_base64.h"
+#include "x509_helper_cache.h"
 #include "x509_helper_check.h"
+#include "x509_helper_digest.h"
 #include "x509_helper_fetch.h"
 #include "x509_helper_globus.h"
 #include "x509_helper_log.h"
+#include "x509_helper_membership.h"
 #include "x509_helper_req.h"
+#include "x509_helper_truststore.h"
+#include "x509_helper_ttl.h"
 #include "x509_helper_voms.h"
 
 #include "scitoken_helper_loader.h"
@@ -63,18 +72,6 @@ static void Read(void *buf, size_t nbyte) {
 }
 
 
-/**
- * Send bytes to stdout.
- */
-static void Write(const void *buf, size_t nbyte) {
-  int num_bytes;
-  do {
-    num_bytes = write(fileno(stdout), buf, nbyte);
-  } while ((num_bytes < 0) && (errno == EINTR));
-  assert((num_bytes >= 0) && (static_cast<size_t>(num_bytes) == nbyte));
-}
-
-
 /**
  * Reads a complete message from the cvmfs client.
  */
@@ -93,17 +90,50 @@ static string ReadMsg() {
 
 
 /**
- * Sends a (JSON formatted) message back to the cvmfs client.
+ * Sends a (JSON formatted) message back to the cvmfs client.  The message is
+ * the concatenation of body and tail; both go out with the header in a single
+ * system call.
  */
-static void WriteMsg(const string &msg) {
+static void WriteMsg(const string &body, const string &tail) {
   struct {
     uint32_t version;
     uint32_t length;
   } header;
   header.version = kProtocolVersion;
-  header.length = msg.length();
-  Write(&header, sizeof(header));
-  Write(msg.data(), header.length);
+  header.length = body.length() + tail.length();
+
+  struct iovec iov[3];
+  iov[0].iov_base = &header;
+  iov[0].iov_len = sizeof(header);
+  iov[1].iov_base = const_cast<char *>(body.data());
+  iov[1].iov_len = body.length();
+  iov[2].iov_base = const_cast<char *>(tail.data());
+  iov[2].iov_len = tail.length();
+  struct iovec *next = iov;
+  int iovcnt = 3;
+  while (iovcnt > 0) {
+    const ssize_t num_bytes = writev(fileno(stdout), next, iovcnt);
+    if (num_bytes < 0) {
+      assert(errno == EINTR);
+      continue;
+    }
+    // Skip what was written, possibly continuing inside an iovec
+    size_t written = num_bytes;
+    while ((iovcnt > 0) && (written >= next->iov_len)) {
+      written -= next->iov_len;
+      ++next;
+      --iovcnt;
+    }
+    if (iovcnt > 0) {
+      next->iov_base = reinterpret_cast<char *>(next->iov_base) + written;
+      next->iov_len -= written;
+    }
+  }
+}
+
+
+static void WriteMsg(const string &msg) {
+  WriteMsg(msg, "");
 }
 
 
@@ -157,7 +187,7 @@ static AuthzRequest ParseRequest(const string &msg) {
     } else if (name == "pid") {
       result.pid = json->int_value;
     } else if (name == "membership") {
-      result.membership = Debase64(string(json->string_value));
+      result.membership = json->string_value;
     } else if (name == "msgid") {
       if (json->int_value == 4) {  /* kAuthzMsgQuit */
         LogAuthz(kLogAuthzDebug, "shut down");
@@ -171,6 +201,24 @@ static AuthzRequest ParseRequest(const string &msg) {
 }
 
 
+static string StringifyUint(unsigned value) {
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%u", value);
+  return string(buf);
+}
+
+
+/**
+ * A negative reply with the given status (see AuthzStatus in cvmfs).
+ */
+static void WriteFailure(int status, const string &failure_key) {
+  const unsigned ttl = GetFailureTtl(failure_key);
+  WriteMsg("{\"cvmfs_authz_v1\":{\"msgid\":3,\"revision\":0,"
+           "\"status\":" + StringifyUint(status) +
+           ",\"ttl\":" + StringifyUint(ttl) + "}}");
+}
+
+
 /**
  * This binary is supposed to be called from the cvmfs client, not stand-alone.
  */
@@ -183,14 +231,67 @@ static void CheckCallContext() {
 }
 
 
+/**
+ * The Globus and VOMS libraries and the trust store are only needed for X.509
+ * requests.  They are loaded after the handshake reply: in the background by
+ * the x509 helper, which needs them for every request, and on demand by the
+ * scitoken helper, which may never need them.
+ */
+static pthread_t g_warmup_thread;
+static bool g_warmup_running = false;
+static bool g_x509_loaded = false;
+
+static void LoadX509Libraries() {
+  if (GetX509Backend() == kX509BackendGlobus)
+    GlobusLib::GetInstance();
+  VomsLib::GetInstance();
+  TrustStore::GetInstance();
+}
+
+
+static void *MainWarmUp(void *data __attribute__((unused))) {
+  LoadX509Libraries();
+  return NULL;
+}
+
+
+static void StartWarmUp() {
+  g_warmup_running =
+    (pthread_create(&g_warmup_thread, NULL, MainWarmUp, NULL) == 0);
+}
+
+
+/**
+ * The warm-up overlaps only with waiting for the first request.  It has to
+ * be finished before credentials are resolved: chroot() and seteuid() in
+ * OpenFileAs() apply to the whole process and would redirect the dlopen()
+ * and CA directory reads of the thread into the requester's container.
+ * Nor must the namespace workers be forked while the thread holds locks.
+ */
+static void FinishWarmUp() {
+  if (g_warmup_running) {
+    pthread_join(g_warmup_thread, NULL);
+    g_warmup_running = false;
+  }
+}
+
+
+static void EnsureX509Libraries() {
+  if (g_x509_loaded)
+    return;
+  FinishWarmUp();
+  LoadX509Libraries();
+  g_x509_loaded = true;
+}
+
+
 int main(int argc, char **argv) {
   CheckCallContext();
 
   // Handshake
   string msg = ReadMsg();
   ParseHandshakeInit(msg);
-  GlobusLib::GetInstance();
-  VomsLib::GetInstance();
+  const bool use_globus = (GetX509Backend() == kX509BackendGlobus);
   WriteMsg("{\"cvmfs_authz_v1\":{\"msgid\":1,\"revision\":0}}");
   LogAuthz(kLogAuthzDebug | kLogAuthzSyslog,
            "x509 authz helper invoked, connected to cvmfs process %d",
@@ -199,38 +300,65 @@ int main(int argc, char **argv) {
   CheckSciToken_t checker = NULL;
   if (strcmp(basename(argv[0]), "cvmfs_scitoken_helper") == 0) {
     checker = SciTokenLib::GetInstance();
+  } else {
+    StartWarmUp();
   }
   LogAuthz(kLogAuthzDebug, "Executable: %s", basename(argv[0]));
 
+  // The environment of the requesting process is scanned once per request
+  // for all the variables that the fetchers need
+  vector<string> env_names;
+  env_names.push_back("X509_USER_PROXY");
+  // Get the environment variable CVMFS_TOKEN_VARNAME
+  const char *var_name;
+  if (getenv("CVMFS_TOKEN_VARNAME")) {
+    var_name = getenv("CVMFS_TOKEN_VARNAME");
+  } else {
+    var_name = "BEARER_TOKEN_FILE";
+  }
+  if (checker) {
+    env_names.push_back("BEARER_TOKEN");
+    env_names.push_back("XDG_RUNTIME_DIR");
+    env_names.push_back(var_name);
+  }
+
   FILE *fp_debug = GetLogAuthzDebugFile();
   while (true) {
+    // Prepare the Globus objects for the next request while we are idle
+    if (use_globus && g_x509_loaded)
+      GlobusLib::GetInstance()->Replenish();
     msg = ReadMsg();
     LogAuthz(kLogAuthzDebug, "got authz request %s", msg.c_str());
     AuthzRequest request = ParseRequest(msg);
+    const MembershipRules *membership =
+      MembershipCache::GetInstance()->Get(request.membership);
+
+    FinishWarmUp();
+    ProcessInfo process;
+    GetProcessInfo(request, env_names, &process);
 
     // Try SciTokens first, if it was invoked as the cvmfs_scitoken_helper
     if (checker) {
       LogAuthz(kLogAuthzDebug, "Using SciTokens checker");
-      // Get the environment variable CVMFS_TOKEN_VARNAME
-      const char* var_name;
-      if (getenv("CVMFS_TOKEN_VARNAME")) {
-        var_name = getenv("CVMFS_TOKEN_VARNAME");
-      } else {
-        var_name = "BEARER_TOKEN_FILE";
-      }
       string token;
-      FILE *fp_token = GetSciToken(request, &token, var_name);
+      FILE *fp_token = GetSciToken(request, process, &token, var_name);
       // This will close fp_token along the way.
       if (fp_token) {
         LogAuthz(kLogAuthzDebug, "Calling SciTokens checker");
         StatusSciTokenValidation validation_status =
-          (*checker)(request.membership.c_str(), fp_token, fp_debug);
+          (*checker)(membership->text().c_str(), fp_token, fp_debug);
         LogAuthz(kLogAuthzDebug, "validation status is %d", validation_status);
         fclose(fp_token);
 
         if (validation_status == kCheckTokenGood) {
-          WriteMsg("{\"cvmfs_authz_v1\":{\"msgid\":3,\"revision\":0,"
-                    "\"status\":0,\"bearer_token\":\"" + token + "\"}}");
+          const string key = "token:" + Sha256(token);
+          const string *body = ReplyCache::GetInstance()->Lookup(key);
+          if (body == NULL) {
+            body = ReplyCache::GetInstance()->Insert(key,
+              "{\"cvmfs_authz_v1\":{\"msgid\":3,\"revision\":0,"
+              "\"status\":0,\"bearer_token\":\"" + token + "\"");
+          }
+          WriteMsg(*body, "}}");
           continue;
         }
       }
@@ -238,32 +366,53 @@ int main(int argc, char **argv) {
 
     // The rest of this is trying with the x509 proxy
     string proxy;
-    FILE *fp_proxy = GetX509Proxy(request, &proxy);
-    if (fp_proxy == NULL) {
-      // kAuthzNotFound, 5 seconds TTL
+    string fingerprint;
+    ProxySource source;
+    const ProxyStatus proxy_status =
+      GetX509Proxy(request, &process, &proxy, &fingerprint, &source);
+    if (proxy_status == kProxyNotFound) {
+      // kAuthzNotFound
       LogAuthz(kLogAuthzDebug, "reply 'proxy not found'");
-      WriteMsg("{\"cvmfs_authz_v1\":{\"msgid\":3,\"revision\":0,"
-                "\"status\":1,\"ttl\":5}}");
+      WriteFailure(1, "uid:" + StringifyUint(request.uid));
+      continue;
+    }
+    if (proxy_status == kProxyKnownInvalid) {
+      // kAuthzInvalid
+      LogAuthz(kLogAuthzDebug, "reply 'invalid proxy'");
+      WriteFailure(2, fingerprint + ":" + membership->key());
       continue;
     }
 
-    // This will close fp_proxy along the way.
+    EnsureX509Libraries();
+    time_t not_after;
     StatusX509Validation validation_status =
-      CheckX509Proxy(request.membership, fp_proxy);
+      CheckX509Proxy(*membership, fingerprint, proxy, &not_after);
     LogAuthz(kLogAuthzDebug, "validation status is %d", validation_status);
+    const string failure_key = fingerprint + ":" + membership->key();
     switch (validation_status) {
       case kCheckX509Invalid:
-        WriteMsg("{\"cvmfs_authz_v1\":{\"msgid\":3,\"revision\":0,"
-                "\"status\":2,\"ttl\":5}}");
+        // kAuthzInvalid
+        RememberInvalidProxy(source, fingerprint);
+        WriteFailure(2, failure_key);
         break;
       case kCheckX509NotMember:
-        WriteMsg("{\"cvmfs_authz_v1\":{\"msgid\":3,\"revision\":0,"
-                  "\"status\":3,\"ttl\":5}}");
+        // kAuthzNotMember
+        WriteFailure(3, failure_key);
         break;
-      case kCheckX509Good:
-        WriteMsg("{\"cvmfs_authz_v1\":{\"msgid\":3,\"revision\":0,"
-                  "\"status\":0,\"x509_proxy\":\"" + Base64(proxy) + "\"}}");
+      case kCheckX509Good: {
+        const string key = "x509:" + fingerprint;
+        const string *body = ReplyCache::GetInstance()->Lookup(key);
+        if (body == NULL) {
+          body = ReplyCache::GetInstance()->Insert(key,
+            "{\"cvmfs_authz_v1\":{\"msgid\":3,\"revision\":0,"
+            "\"status\":0,\"x509_proxy\":\"" + Base64(proxy) + "\"");
+        } else {
+          LogAuthz(kLogAuthzDebug, "using cached reply");
+        }
+        WriteMsg(*body,
+                 ",\"ttl\":" + StringifyUint(GetSuccessTtl(not_after)) + "}}");
         break;
+      }
       default:
         abort();
     }
@@ -6,7 +6,7 @@
 
 #include <stdint.h>
 
-#include <cassert>
+#include "x509_helper_base64_simd.h"
 
 using namespace std;  // NOLINT
 
@@ -25,7 +25,7 @@ const signed char db64_table[] =
   { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
     -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
     -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,
-    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1,  0, -1, -1,
+    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
     -1,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
     15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1,
     -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
@@ -41,6 +41,30 @@ const signed char db64_table[] =
     -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
   };
 
+/**
+ * The vectorized loops that the CPU supports, determined once.
+ */
+struct Base64Impl {
+  Base64Impl() : has_sse41(false), has_avx2(false) {
+#if defined(HAVE_BASE64_SSE41) || defined(HAVE_BASE64_AVX2)
+    __builtin_cpu_init();
+#endif
+#ifdef HAVE_BASE64_SSE41
+    has_sse41 = __builtin_cpu_supports("sse4.1");
+#endif
+#ifdef HAVE_BASE64_AVX2
+    has_avx2 = __builtin_cpu_supports("avx2");
+#endif
+  }
+  bool has_sse41;
+  bool has_avx2;
+};
+
+const Base64Impl &GetBase64Impl() {
+  static const Base64Impl impl;
+  return impl;
+}
+
 }  // anonymous namespace
 
 
@@ -55,16 +79,29 @@ static inline void Base64Block(const unsigned char input[3], const char *table,
 
 
 string Base64(const string &data) {
-  string result;
-  result.reserve((data.length()+3)*4/3);
-  unsigned pos = 0;
   const unsigned char *data_ptr =
     reinterpret_cast<const unsigned char *>(data.data());
-  const unsigned length = data.length();
-  while (pos+2 < length) {
-    char encoded_block[4];
-    Base64Block(data_ptr+pos, b64_table, encoded_block);
-    result.append(encoded_block, 4);
+  const size_t length = data.length();
+  string result;
+  result.resize((length + 2) / 3 * 4);
+  char *out = length ? &result[0] : NULL;
+
+  size_t pos = 0;
+  const Base64Impl &impl = GetBase64Impl();
+#ifdef HAVE_BASE64_AVX2
+  if (impl.has_avx2)
+    pos = Base64EncodeAvx2(data_ptr, length, out);
+#endif
+#ifdef HAVE_BASE64_SSE41
+  if (impl.has_sse41)
+    pos += Base64EncodeSse41(data_ptr + pos, length - pos, out + pos / 3 * 4);
+#endif
+  (void)impl;
+
+  out += pos / 3 * 4;
+  while (pos + 2 < length) {
+    Base64Block(data_ptr + pos, b64_table, out);
+    out += 4;
     pos += 3;
   }
   if (length % 3 != 0) {
@@ -74,55 +111,79 @@ string Base64(const string &data) {
     input[2] = 0;
     char encoded_block[4];
     Base64Block(input, b64_table, encoded_block);
-    result.append(encoded_block, 2);
-    result.push_back(((length % 3) == 2) ? encoded_block[2] : '=');
-    result.push_back('=');
+    out[0] = encoded_block[0];
+    out[1] = encoded_block[1];
+    out[2] = ((length % 3) == 2) ? encoded_block[2] : '=';
+    out[3] = '=';
   }
 
   return result;
 }
 
 
-static void Debase64Block(const unsigned char input[4],
+/**
+ * Decodes the first 4 - npad characters of input; returns false if any of
+ * them is not in the alphabet.
+ */
+static bool Debase64Block(const unsigned char input[4], unsigned npad,
                           const signed char *d_table,
                           unsigned char output[3])
 {
-  int32_t dec[4];
-  for (int i = 0; i < 4; ++i) {
-    dec[i] = db64_table[input[i]];
-    // Invalid Base64?
-    assert(dec[i] >= 0);
+  int32_t dec[4] = {0, 0, 0, 0};
+  for (unsigned i = 0; i < 4 - npad; ++i) {
+    dec[i] = d_table[input[i]];
+    if (dec[i] < 0)
+      return false;
   }
 
   output[0] = (dec[0] << 2) | (dec[1] >> 4);
   output[1] = ((dec[1] & 0x0F) << 4) | (dec[2] >> 2);
   output[2] = ((dec[2] & 0x03) << 6) | dec[3];
+  return true;
 }
 
 
-string Debase64(const string &data) {
-  unsigned pos = 0;
-  const unsigned char *data_ptr =
-    reinterpret_cast<const unsigned char *>(data.data());
-  const unsigned length = data.length();
+bool Debase64(const string &data, string *decoded) {
+  decoded->clear();
+  const size_t length = data.length();
   if (length == 0)
-    return "";
-  // Invalid Base64?
-  assert((length % 4) == 0);
+    return true;
+  if ((length % 4) != 0)
+    return false;
+  unsigned npad = 0;
+  if (data[length - 1] == '=')
+    npad = (data[length - 2] == '=') ? 2 : 1;
 
+  const unsigned char *data_ptr =
+    reinterpret_cast<const unsigned char *>(data.data());
   string result;
-  result.reserve((length + 4) * 3/4);
+  result.resize(length / 4 * 3 + kBase64DecodeSlack);
+  unsigned char *out = reinterpret_cast<unsigned char *>(&result[0]);
+
+  // The vectorized loops stop at the block with the padding
+  size_t pos = 0;
+  const Base64Impl &impl = GetBase64Impl();
+#ifdef HAVE_BASE64_AVX2
+  if (impl.has_avx2)
+    pos = Base64DecodeAvx2(data.data(), length, out);
+#endif
+#ifdef HAVE_BASE64_SSE41
+  if (impl.has_sse41)
+    pos += Base64DecodeSse41(data.data() + pos, length - pos,
+                             out + pos / 4 * 3);
+#endif
+  (void)impl;
+
+  out += pos / 4 * 3;
   while (pos < length) {
-    unsigned char decoded_block[3];
-    Debase64Block(data_ptr+pos, db64_table, decoded_block);
-    result.append(reinterpret_cast<char *>(decoded_block), 3);
+    const unsigned block_npad = (pos + 4 == length) ? npad : 0;
+    if (!Debase64Block(data_ptr + pos, block_npad, db64_table, out))
+      return false;
+    out += 3;
     pos += 4;
   }
 
-  for (int i = 0; i < 2; ++i) {
-    pos--;
-    if (data[pos] == '=')
-      result.erase(result.length()-1);
-  }
-  return result;
+  result.resize(length / 4 * 3 - npad);
+  decoded->swap(result);
+  return true;
 }
@@ -8,6 +8,12 @@
 #include <string>
 
 std::string Base64(const std::string &data);
-std::string Debase64(const std::string &data);
+
+/**
+ * Decodes padded Base64.  Returns false on invalid input, i.e. on characters
+ * outside the alphabet, misplaced padding or a length that is not a multiple
+ * of 4.
+ */
+bool Debase64(const std::string &data, std::string *decoded);
 
 #endif  // CVMFS_AUTHZ_X509_HELPER_BASE64_H_
@@ -0,0 +1,105 @@
+/**
+ * This file is part of the CernVM File System.
+ *
+ * Compiled with -mavx2.  Same algorithms as x509_helper_base64_sse41.cc on
+ * two 128 bit lanes.
+ */
+
+#include "x509_helper_base64_simd.h"
+
+#include <immintrin.h>
+
+using namespace std;  // NOLINT
+
+namespace {
+
+inline __m256i Broadcast(const __m128i lane) {
+  return _mm256_broadcastsi128_si256(lane);
+}
+
+
+inline __m256i EncodeReshuffle(__m256i input) {
+  input = _mm256_shuffle_epi8(input, Broadcast(_mm_set_epi8(
+    10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1)));
+  const __m256i t0 = _mm256_and_si256(input, _mm256_set1_epi32(0x0fc0fc00));
+  const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+  const __m256i t2 = _mm256_and_si256(input, _mm256_set1_epi32(0x003f03f0));
+  const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+  return _mm256_or_si256(t1, t3);
+}
+
+
+inline __m256i EncodeTranslate(const __m256i indices) {
+  __m256i range = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+  const __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+  range = _mm256_or_si256(range, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+  const __m256i shift = Broadcast(_mm_setr_epi8(
+    'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+    '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0));
+  return _mm256_add_epi8(_mm256_shuffle_epi8(shift, range), indices);
+}
+
+}  // anonymous namespace
+
+
+size_t Base64EncodeAvx2(const unsigned char *src, size_t length, char *dst) {
+  size_t pos = 0;
+  // The upper lane is loaded from src + 12 and reaches up to src + 28
+  while (pos + 28 <= length) {
+    const __m128i lo =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + pos));
+    const __m128i hi =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + pos + 12));
+    const __m256i input =
+      _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst),
+                        EncodeTranslate(EncodeReshuffle(input)));
+    pos += 24;
+    dst += 32;
+  }
+  return pos;
+}
+
+
+size_t Base64DecodeAvx2(const char *src, size_t length, unsigned char *dst) {
+  const __m256i lut_lo = Broadcast(_mm_setr_epi8(
+    0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+    0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A));
+  const __m256i lut_hi = Broadcast(_mm_setr_epi8(
+    0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+    0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10));
+  const __m256i lut_roll = Broadcast(_mm_setr_epi8(
+    0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0));
+  const __m256i mask_2f = _mm256_set1_epi8(0x2F);
+
+  size_t pos = 0;
+  while (pos + 32 <= length) {
+    __m256i str =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + pos));
+    const __m256i hi_nibbles =
+      _mm256_and_si256(_mm256_srli_epi32(str, 4), mask_2f);
+    const __m256i lo_nibbles = _mm256_and_si256(str, mask_2f);
+    const __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+    const __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+    if (!_mm256_testz_si256(lo, hi))
+      break;
+
+    const __m256i eq_2f = _mm256_cmpeq_epi8(str, mask_2f);
+    const __m256i roll =
+      _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles));
+    str = _mm256_add_epi8(str, roll);
+
+    const __m256i merged =
+      _mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140));
+    __m256i output = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+    output = _mm256_shuffle_epi8(output, Broadcast(_mm_setr_epi8(
+      2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1)));
+    // Move the 12 bytes of the upper lane next to those of the lower one
+    output = _mm256_permutevar8x32_epi32(
+      output, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), output);
+    pos += 32;
+    dst += 24;
+  }
+  return pos;
+}
@@ -0,0 +1,36 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_AUTHZ_X509_HELPER_BASE64_SIMD_H_
+#define CVMFS_AUTHZ_X509_HELPER_BASE64_SIMD_H_
+
+#include <cstddef>
+
+/**
+ * Vectorized inner loops of the Base64 codec, compiled with the respective
+ * instruction set enabled and only called if the CPU supports it.
+ *
+ * The encoders consume whole blocks of 12 (SSE4.1) or 24 (AVX2) bytes for as
+ * long as a full vector can be loaded and return the number of input bytes
+ * consumed; they write 4/3 as many characters.
+ *
+ * The decoders consume blocks of 16 (SSE4.1) or 32 (AVX2) characters and stop
+ * at the first block that contains anything but the 64 Base64 characters,
+ * including padding; the rest is left to the scalar code.  They return the
+ * number of characters consumed and write 3/4 as many bytes but may store up
+ * to kBase64DecodeSlack bytes beyond that.
+ */
+const size_t kBase64DecodeSlack = 8;
+
+#ifdef HAVE_BASE64_SSE41
+size_t Base64EncodeSse41(const unsigned char *src, size_t length, char *dst);
+size_t Base64DecodeSse41(const char *src, size_t length, unsigned char *dst);
+#endif
+
+#ifdef HAVE_BASE64_AVX2
+size_t Base64EncodeAvx2(const unsigned char *src, size_t length, char *dst);
+size_t Base64DecodeAvx2(const char *src, size_t length, unsigned char *dst);
+#endif
+
+#endif  // CVMFS_AUTHZ_X509_HELPER_BASE64_SIMD_H_
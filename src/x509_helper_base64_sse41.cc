@@ -0,0 +1,98 @@
+/**
+ * This file is part of the CernVM File System.
+ *
+ * Compiled with -msse4.1.  The algorithms are the ones by W. Mula and
+ * D. Lemire, "Faster Base64 Encoding and Decoding Using AVX2 Instructions".
+ */
+
+#include "x509_helper_base64_simd.h"
+
+#include <smmintrin.h>
+
+using namespace std;  // NOLINT
+
+namespace {
+
+/**
+ * Spreads 12 input bytes to 16 lanes holding one 6 bit index each.
+ */
+inline __m128i EncodeReshuffle(__m128i input) {
+  input = _mm_shuffle_epi8(input, _mm_set_epi8(
+    10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+  const __m128i t0 = _mm_and_si128(input, _mm_set1_epi32(0x0fc0fc00));
+  const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+  const __m128i t2 = _mm_and_si128(input, _mm_set1_epi32(0x003f03f0));
+  const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+  return _mm_or_si128(t1, t3);
+}
+
+
+/**
+ * Maps indices 0..63 to the Base64 alphabet by adding a per-range offset.
+ */
+inline __m128i EncodeTranslate(const __m128i indices) {
+  __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+  const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+  range = _mm_or_si128(range, _mm_and_si128(less, _mm_set1_epi8(13)));
+  const __m128i shift = _mm_setr_epi8(
+    'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+    '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+  return _mm_add_epi8(_mm_shuffle_epi8(shift, range), indices);
+}
+
+}  // anonymous namespace
+
+
+size_t Base64EncodeSse41(const unsigned char *src, size_t length, char *dst) {
+  size_t pos = 0;
+  while (pos + 16 <= length) {
+    const __m128i input =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + pos));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst),
+                     EncodeTranslate(EncodeReshuffle(input)));
+    pos += 12;
+    dst += 16;
+  }
+  return pos;
+}
+
+
+size_t Base64DecodeSse41(const char *src, size_t length, unsigned char *dst) {
+  // Classify characters by their nibbles; a non-zero AND marks invalid ones
+  const __m128i lut_lo = _mm_setr_epi8(
+    0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+    0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+  const __m128i lut_hi = _mm_setr_epi8(
+    0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+    0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m128i lut_roll = _mm_setr_epi8(
+    0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i mask_2f = _mm_set1_epi8(0x2F);
+
+  size_t pos = 0;
+  while (pos + 16 <= length) {
+    __m128i str = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + pos));
+    const __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask_2f);
+    const __m128i lo_nibbles = _mm_and_si128(str, mask_2f);
+    const __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+    const __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+    if (!_mm_testz_si128(lo, hi))
+      break;
+
+    const __m128i eq_2f = _mm_cmpeq_epi8(str, mask_2f);
+    const __m128i roll =
+      _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles));
+    str = _mm_add_epi8(str, roll);
+
+    // Pack the 16 6 bit values into 12 bytes
+    const __m128i merged =
+      _mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140));
+    __m128i output = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+    output = _mm_shuffle_epi8(output, _mm_setr_epi8(
+      2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), output);
+    pos += 16;
+    dst += 12;
+  }
+  return pos;
+}
@@ -0,0 +1,406 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+#include "x509_helper_bundle.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "x509_helper_log.h"
+
+using namespace std;  // NOLINT
+
+
+TrustFileKind ClassifyTrustFile(const string &name) {
+  const size_t kHashLen = 8;
+  if ((name.length() < kHashLen + 2) || (name[kHashLen] != '.'))
+    return kTrustFileUnknown;
+  for (unsigned i = 0; i < kHashLen; ++i) {
+    if (!isxdigit(name[i]))
+      return kTrustFileUnknown;
+  }
+  const string suffix = name.substr(kHashLen + 1);
+  if (suffix == "signing_policy")
+    return kTrustFileSigningPolicy;
+  if (suffix == "namespaces")
+    return kTrustFileNamespaces;
+  const bool is_crl = (suffix[0] == 'r');
+  const size_t digits_start = is_crl ? 1 : 0;
+  if (suffix.length() == digits_start)
+    return kTrustFileUnknown;
+  for (unsigned i = digits_start; i < suffix.length(); ++i) {
+    if (!isdigit(suffix[i]))
+      return kTrustFileUnknown;
+  }
+  return is_crl ? kTrustFileCrl : kTrustFileCa;
+}
+
+
+namespace {
+
+struct BundleRecord {
+  uint32_t name_hash;
+  TrustFileKind kind;
+  string blob;
+};
+
+}  // anonymous namespace
+
+
+static string DerEncode(X509 *cert) {
+  unsigned char *der = NULL;
+  int der_len = i2d_X509(cert, &der);
+  if (der_len <= 0)
+    return "";
+  string result(reinterpret_cast<char *>(der), der_len);
+  OPENSSL_free(der);
+  return result;
+}
+
+
+static string DerEncode(X509_CRL *crl) {
+  unsigned char *der = NULL;
+  int der_len = i2d_X509_CRL(crl, &der);
+  if (der_len <= 0)
+    return "";
+  string result(reinterpret_cast<char *>(der), der_len);
+  OPENSSL_free(der);
+  return result;
+}
+
+
+/**
+ * Appends the records found in one file of the certificates directory.
+ */
+static void ReadTrustFile(const string &path, const string &name,
+                          vector<BundleRecord> *records,
+                          vector<RevokedKey> *revoked)
+{
+  const TrustFileKind kind = ClassifyTrustFile(name);
+  BIO *bio = BIO_new_file(path.c_str(), "r");
+  if (bio == NULL) {
+    LogAuthz(kLogAuthzDebug, "failed to open %s", path.c_str());
+    return;
+  }
+
+  BundleRecord record;
+  record.kind = kind;
+  if ((kind == kTrustFileSigningPolicy) || (kind == kTrustFileNamespaces)) {
+    record.name_hash = strtoul(name.substr(0, 8).c_str(), NULL, 16);
+    char buf[4096];
+    int nbytes;
+    while ((nbytes = BIO_read(bio, buf, sizeof(buf))) > 0)
+      record.blob.append(buf, nbytes);
+    records->push_back(record);
+    BIO_free(bio);
+    return;
+  }
+
+  bool found = false;
+  STACK_OF(X509_INFO) *infos = PEM_X509_INFO_read_bio(bio, NULL, NULL, NULL);
+  for (int i = 0; infos && (i < sk_X509_INFO_num(infos)); ++i) {
+    X509_INFO *info = sk_X509_INFO_value(infos, i);
+    if (info->x509 && (kind == kTrustFileCa)) {
+      record.name_hash = X509_NAME_hash(X509_get_subject_name(info->x509));
+      record.blob = DerEncode(info->x509);
+    } else if (info->crl && (kind == kTrustFileCrl)) {
+      record.name_hash = X509_NAME_hash(X509_CRL_get_issuer(info->crl));
+      record.blob = DerEncode(info->crl);
+      AddRevokedKeys(info->crl, revoked);
+    } else {
+      continue;
+    }
+    if (!record.blob.empty()) {
+      records->push_back(record);
+      found = true;
+    }
+  }
+  if (infos)
+    sk_X509_INFO_pop_free(infos, X509_INFO_free);
+  if (!found && (kind == kTrustFileCrl)) {
+    BIO_reset(bio);
+    X509_CRL *crl = d2i_X509_CRL_bio(bio, NULL);
+    if (crl) {
+      record.name_hash = X509_NAME_hash(X509_CRL_get_issuer(crl));
+      record.blob = DerEncode(crl);
+      AddRevokedKeys(crl, revoked);
+      X509_CRL_free(crl);
+      records->push_back(record);
+      found = true;
+    }
+  }
+  ERR_clear_error();
+  if (!found)
+    LogAuthz(kLogAuthzDebug, "no certificate or CRL found in %s", path.c_str());
+  BIO_free(bio);
+}
+
+
+static bool WriteAll(int fd, const void *buf, size_t nbytes) {
+  const char *ptr = reinterpret_cast<const char *>(buf);
+  while (nbytes > 0) {
+    ssize_t written = write(fd, ptr, nbytes);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    ptr += written;
+    nbytes -= written;
+  }
+  return true;
+}
+
+
+static uint64_t Align8(uint64_t offset) {
+  return (offset + 7) & ~static_cast<uint64_t>(7);
+}
+
+
+bool WriteTrustBundle(const string &cert_dir, const string &path) {
+  DIR *dirp = opendir(cert_dir.c_str());
+  if (dirp == NULL) {
+    LogAuthz(kLogAuthzDebug | kLogAuthzSyslogErr,
+             "failed to open trusted certificates directory %s (%d)",
+             cert_dir.c_str(), errno);
+    return false;
+  }
+  vector<string> names;
+  struct dirent *dent;
+  while ((dent = readdir(dirp)) != NULL) {
+    if (ClassifyTrustFile(dent->d_name) != kTrustFileUnknown)
+      names.push_back(dent->d_name);
+  }
+  closedir(dirp);
+  sort(names.begin(), names.end());
+
+  vector<BundleRecord> records;
+  vector<RevokedKey> revoked;
+  for (unsigned i = 0; i < names.size(); ++i)
+    ReadTrustFile(cert_dir + "/" + names[i], names[i], &records, &revoked);
+  vector<RevokedKey> revoked_table;
+  BuildRevocationTable(revoked, &revoked_table);
+
+  uint32_t nbuckets = 1;
+  while (nbuckets < 2 * records.size())
+    nbuckets *= 2;
+  vector<uint32_t> buckets(nbuckets, kBundleNil);
+  vector<BundleEntry> entries(records.size());
+  uint64_t data_size = 0;
+  for (unsigned i = 0; i < records.size(); ++i) {
+    BundleEntry *entry = &entries[i];
+    memset(entry, 0, sizeof(*entry));
+    entry->name_hash = records[i].name_hash;
+    entry->kind = records[i].kind;
+    entry->offset = data_size;
+    entry->length = records[i].blob.length();
+    // Keep the bucket chains in directory order
+    entry->next = kBundleNil;
+    uint32_t *link = &buckets[entry->name_hash & (nbuckets - 1)];
+    while (*link != kBundleNil)
+      link = &entries[*link].next;
+    *link = i;
+    data_size = Align8(data_size + entry->length);
+  }
+
+  BundleHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kBundleMagic, sizeof(header.magic));
+  header.version = kBundleVersion;
+  header.byte_order = kBundleByteOrder;
+  header.nentries = entries.size();
+  header.nbuckets = nbuckets;
+  header.entries_offset = Align8(sizeof(header));
+  header.buckets_offset =
+    Align8(header.entries_offset + entries.size() * sizeof(BundleEntry));
+  header.data_offset =
+    Align8(header.buckets_offset + nbuckets * sizeof(uint32_t));
+  header.revoked_offset = Align8(header.data_offset + data_size);
+  header.nrevoked_slots = revoked_table.size();
+  header.size =
+    header.revoked_offset + revoked_table.size() * sizeof(RevokedKey);
+
+  string image(header.size, '\0');
+  memcpy(&image[0], &header, sizeof(header));
+  if (!entries.empty()) {
+    memcpy(&image[header.entries_offset], &entries[0],
+           entries.size() * sizeof(BundleEntry));
+  }
+  memcpy(&image[header.buckets_offset], &buckets[0],
+         nbuckets * sizeof(uint32_t));
+  for (unsigned i = 0; i < records.size(); ++i) {
+    if (records[i].blob.empty())
+      continue;
+    memcpy(&image[header.data_offset + entries[i].offset],
+           records[i].blob.data(), records[i].blob.length());
+  }
+  memcpy(&image[header.revoked_offset], &revoked_table[0],
+         revoked_table.size() * sizeof(RevokedKey));
+
+  const string tmp_path = path + ".XXXXXX";
+  char *tmp_name = strdup(tmp_path.c_str());
+  int fd = mkstemp(tmp_name);
+  if (fd < 0) {
+    LogAuthz(kLogAuthzDebug | kLogAuthzSyslogErr,
+             "failed to create %s (%d)", tmp_name, errno);
+    free(tmp_name);
+    return false;
+  }
+  const bool written = WriteAll(fd, image.data(), image.length()) &&
+                       (fchmod(fd, 0644) == 0) && (fsync(fd) == 0);
+  close(fd);
+  if (!written || (rename(tmp_name, path.c_str()) != 0)) {
+    LogAuthz(kLogAuthzDebug | kLogAuthzSyslogErr,
+             "failed to write trust bundle %s (%d)", path.c_str(), errno);
+    unlink(tmp_name);
+    free(tmp_name);
+    return false;
+  }
+  free(tmp_name);
+  LogAuthz(kLogAuthzDebug, "wrote %u entries and %u revocations from %s to %s",
+           header.nentries, static_cast<unsigned>(revoked.size()),
+           cert_dir.c_str(), path.c_str());
+  return true;
+}
+
+
+TrustBundle *TrustBundle::Open(const string &path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    LogAuthz(kLogAuthzDebug, "failed to open trust bundle %s (%d)",
+             path.c_str(), errno);
+    return NULL;
+  }
+  struct stat info;
+  if ((fstat(fd, &info) != 0) ||
+      (static_cast<size_t>(info.st_size) < sizeof(BundleHeader)))
+  {
+    close(fd);
+    LogAuthz(kLogAuthzDebug, "invalid trust bundle %s", path.c_str());
+    return NULL;
+  }
+  void *map = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    LogAuthz(kLogAuthzDebug, "failed to map trust bundle %s (%d)",
+             path.c_str(), errno);
+    return NULL;
+  }
+
+  TrustBundle *bundle = new TrustBundle();
+  bundle->m_map = map;
+  bundle->m_size = info.st_size;
+  bundle->m_dev = info.st_dev;
+  bundle->m_ino = info.st_ino;
+  const unsigned char *base = reinterpret_cast<const unsigned char *>(map);
+  bundle->m_header = reinterpret_cast<const BundleHeader *>(base);
+  if (!bundle->Validate()) {
+    LogAuthz(kLogAuthzDebug | kLogAuthzSyslogErr,
+             "invalid trust bundle %s", path.c_str());
+    delete bundle;
+    return NULL;
+  }
+  bundle->m_entries = reinterpret_cast<const BundleEntry *>(
+    base + bundle->m_header->entries_offset);
+  bundle->m_buckets = reinterpret_cast<const uint32_t *>(
+    base + bundle->m_header->buckets_offset);
+  bundle->m_data = base + bundle->m_header->data_offset;
+  bundle->m_revoked = reinterpret_cast<const RevokedKey *>(
+    base + bundle->m_header->revoked_offset);
+  return bundle;
+}
+
+
+TrustBundle::~TrustBundle() {
+  if (m_map)
+    munmap(m_map, m_size);
+}
+
+
+/**
+ * The bundle is written by a privileged tool, but a truncated or otherwise
+ * damaged file must not make the helper read outside the mapping.
+ */
+bool TrustBundle::Validate() const {
+  const BundleHeader *h = m_header;
+  if (memcmp(h->magic, kBundleMagic, sizeof(h->magic)) ||
+      (h->version != kBundleVersion) || (h->byte_order != kBundleByteOrder) ||
+      (h->size != m_size) || (h->nbuckets == 0) ||
+      (h->nbuckets & (h->nbuckets - 1)))
+  {
+    return false;
+  }
+  if ((h->entries_offset % 8) || (h->buckets_offset % 8) ||
+      (h->entries_offset > m_size) || (h->buckets_offset > m_size) ||
+      (h->data_offset > m_size) ||
+      (h->nentries > (m_size - h->entries_offset) / sizeof(BundleEntry)) ||
+      (h->nbuckets > (m_size - h->buckets_offset) / sizeof(uint32_t)) ||
+      (h->revoked_offset > m_size) || (h->nrevoked_slots == 0) ||
+      (h->nrevoked_slots & (h->nrevoked_slots - 1)) ||
+      (h->nrevoked_slots >
+       (m_size - h->revoked_offset) / sizeof(RevokedKey)))
+  {
+    return false;
+  }
+  const unsigned char *base = reinterpret_cast<const unsigned char *>(m_map);
+  const BundleEntry *entries =
+    reinterpret_cast<const BundleEntry *>(base + h->entries_offset);
+  const uint32_t *buckets =
+    reinterpret_cast<const uint32_t *>(base + h->buckets_offset);
+  const uint64_t data_size = m_size - h->data_offset;
+  for (uint32_t i = 0; i < h->nentries; ++i) {
+    if ((entries[i].offset > data_size) ||
+        (entries[i].length > data_size - entries[i].offset) ||
+        ((entries[i].next != kBundleNil) &&
+         ((entries[i].next <= i) || (entries[i].next >= h->nentries))))
+    {
+      return false;
+    }
+  }
+  for (uint32_t i = 0; i < h->nbuckets; ++i) {
+    if ((buckets[i] != kBundleNil) && (buckets[i] >= h->nentries))
+      return false;
+  }
+  // Lookups in the revocation index stop at the first empty slot
+  const RevokedKey *revoked =
+    reinterpret_cast<const RevokedKey *>(base + h->revoked_offset);
+  for (uint32_t i = 0; i < h->nrevoked_slots; ++i) {
+    if ((revoked[i].digest[0] & 0x01) == 0)
+      return true;
+  }
+  return false;
+}
+
+
+void TrustBundle::Find(uint32_t name_hash, TrustFileKind kind,
+                       vector<BundleBlob> *blobs) const
+{
+  blobs->clear();
+  uint32_t idx = m_buckets[name_hash & (m_header->nbuckets - 1)];
+  while (idx != kBundleNil) {
+    const BundleEntry &entry = m_entries[idx];
+    if ((entry.name_hash == name_hash) &&
+        (entry.kind == static_cast<uint32_t>(kind)))
+    {
+      BundleBlob blob;
+      blob.index = idx;
+      blob.data = m_data + entry.offset;
+      blob.length = entry.length;
+      blobs->push_back(blob);
+    }
+    idx = entry.next;
+  }
+}
@@ -0,0 +1,130 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_AUTHZ_X509_HELPER_BUNDLE_H_
+#define CVMFS_AUTHZ_X509_HELPER_BUNDLE_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "x509_helper_revocation.h"
+
+/**
+ * Kinds of files in a trusted certificates directory.  Only the files that
+ * OpenSSL and Globus look up by subject hash are considered: <hash>.<n>,
+ * <hash>.r<n>, <hash>.signing_policy and <hash>.namespaces.
+ */
+enum TrustFileKind {
+  kTrustFileUnknown = 0,
+  kTrustFileCa,
+  kTrustFileCrl,
+  kTrustFileSigningPolicy,
+  kTrustFileNamespaces,
+};
+
+TrustFileKind ClassifyTrustFile(const std::string &name);
+
+/**
+ * A trust bundle is a precompiled, read-only image of a trusted certificates
+ * directory that is mapped into memory by every helper process, so that the
+ * page cache holds the trust store only once.  It consists of
+ *
+ *   BundleHeader | BundleEntry[nentries] | uint32_t[nbuckets] | blobs |
+ *   RevokedKey[nrevoked_slots]
+ *
+ * Certificates and CRLs are stored DER encoded, signing policies and
+ * namespaces files verbatim.  Entries are chained in a hash table on the
+ * OpenSSL subject name hash (issuer name hash for CRLs), which is also the
+ * <hash> part of the file names.  The revocation index of all CRLs follows
+ * the blobs (see x509_helper_revocation.h).  The bundle uses the byte order
+ * of the host that built it; a bundle from a different byte order is
+ * rejected.
+ */
+const char kBundleMagic[8] = {'C', 'V', 'M', 'F', 'S', 'T', 'B', '\0'};
+const uint32_t kBundleVersion = 2;
+const uint32_t kBundleByteOrder = 0x01020304;
+const uint32_t kBundleNil = 0xFFFFFFFF;
+
+struct BundleHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t nentries;
+  uint32_t nbuckets;
+  uint64_t entries_offset;
+  uint64_t buckets_offset;
+  uint64_t data_offset;
+  uint64_t size;
+  uint64_t revoked_offset;
+  uint32_t nrevoked_slots;
+  uint32_t padding;
+};
+
+struct BundleEntry {
+  uint32_t name_hash;
+  uint32_t kind;
+  uint64_t offset;  // relative to data_offset
+  uint64_t length;
+  uint32_t next;  // next entry in the same bucket
+  uint32_t padding;
+};
+
+struct BundleBlob {
+  uint32_t index;
+  const unsigned char *data;
+  size_t length;
+};
+
+/**
+ * Compiles the certificates directory cert_dir into a bundle at path.  The
+ * bundle is written to a temporary file first and renamed into place, so that
+ * helpers that have mapped the previous version are not affected.
+ */
+bool WriteTrustBundle(const std::string &cert_dir, const std::string &path);
+
+/**
+ * A mapped bundle.
+ */
+class TrustBundle {
+ public:
+  /**
+   * Returns NULL if the file cannot be mapped or is not a valid bundle.
+   */
+  static TrustBundle *Open(const std::string &path);
+  ~TrustBundle();
+
+  void Find(uint32_t name_hash, TrustFileKind kind,
+            std::vector<BundleBlob> *blobs) const;
+  bool IsRevoked(const RevokedKey &key) const {
+    return FindRevokedKey(m_revoked, m_header->nrevoked_slots, key);
+  }
+
+  uint32_t nentries() const {return m_header->nentries;}
+  dev_t dev() const {return m_dev;}
+  ino_t ino() const {return m_ino;}
+
+ private:
+  TrustBundle() : m_map(NULL), m_size(0), m_header(NULL), m_entries(NULL),
+                  m_buckets(NULL), m_data(NULL), m_revoked(NULL),
+                  m_dev(0), m_ino(0) {}
+  TrustBundle(const TrustBundle&);
+
+  bool Validate() const;
+
+  void *m_map;
+  size_t m_size;
+  const BundleHeader *m_header;
+  const BundleEntry *m_entries;
+  const uint32_t *m_buckets;
+  const unsigned char *m_data;
+  const RevokedKey *m_revoked;
+  dev_t m_dev;
+  ino_t m_ino;
+};
+
+#endif  // CVMFS_AUTHZ_X509_HELPER_BUNDLE_H_
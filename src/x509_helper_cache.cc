@@ -0,0 +1,83 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+#include "x509_helper_cache.h"
+
+#include <algorithm>
+
+#include "x509_helper_log.h"
+
+using namespace std;  // NOLINT
+
+
+bool DecisionCache::Lookup(const string &fingerprint,
+                           const string &membership_key,
+                           StatusX509Validation *status,
+                           time_t *not_after)
+{
+  const Decision *cached = m_entries.Lookup(fingerprint + membership_key);
+  if (cached == NULL)
+    return false;
+  *status = cached->status;
+  *not_after = cached->not_after;
+  return true;
+}
+
+
+void DecisionCache::Insert(const string &fingerprint,
+                           const string &membership_key,
+                           StatusX509Validation status,
+                           time_t not_after)
+{
+  const time_t now = time(NULL);
+  if (not_after <= now)
+    return;
+  const time_t expiry = min(not_after, now + kMaxLifetime);
+  Decision decision;
+  decision.status = status;
+  decision.not_after = not_after;
+  m_entries.Insert(fingerprint + membership_key, decision, expiry);
+  LogAuthz(kLogAuthzDebug, "cached decision %d for %d seconds",
+           status, static_cast<int>(expiry - now));
+}
+
+DecisionCache *DecisionCache::g_decision_cache = NULL;
+ReplyCache *ReplyCache::g_reply_cache = NULL;
+ProcessCache *ProcessCache::g_process_cache = NULL;
+
+
+bool NegativeCache::IsNotFound(const string &key) {
+  const Entry *entry = m_entries.Lookup(key);
+  return (entry != NULL) && !entry->has_identity;
+}
+
+
+bool NegativeCache::IsInvalid(const string &key,
+                              const FileIdentity &identity,
+                              string *fingerprint)
+{
+  const Entry *entry = m_entries.Lookup(key);
+  if ((entry == NULL) || !entry->has_identity || !(entry->identity == identity))
+    return false;
+  *fingerprint = entry->fingerprint;
+  return true;
+}
+
+
+void NegativeCache::InsertNotFound(const string &key) {
+  m_entries.Insert(key, Entry(), time(NULL) + kNotFoundLifetime);
+}
+
+
+void NegativeCache::InsertInvalid(const string &key,
+                                  const FileIdentity &identity,
+                                  const string &fingerprint)
+{
+  Entry entry;
+  entry.has_identity = true;
+  entry.identity = identity;
+  entry.fingerprint = fingerprint;
+  m_entries.Insert(key, entry, time(NULL) + kInvalidLifetime);
+}
+
+NegativeCache *NegativeCache::g_negative_cache = NULL;
@@ -0,0 +1,222 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_AUTHZ_X509_HELPER_CACHE_H_
+#define CVMFS_AUTHZ_X509_HELPER_CACHE_H_
+
+#include <time.h>
+
+#include <string>
+
+#include "helper_utils.h"
+#include "x509_helper_check.h"
+#include "x509_helper_lru.h"
+
+/**
+ * Remembers the outcome of CheckX509Proxy() for a given proxy content and
+ * membership list, so that repeated requests for the same credential do not
+ * go through Globus and VOMS again.  Keys are the SHA-256 of the proxy file
+ * and the key of the membership rules (see MembershipRules::key()).  Only
+ * decisions based on a successfully verified chain (good / not a member) are
+ * stored; each entry expires with the first certificate or attribute
+ * certificate in the chain.
+ */
+class DecisionCache {
+ public:
+  static DecisionCache *GetInstance() {
+    if (!g_decision_cache)
+      g_decision_cache = new DecisionCache();
+    return g_decision_cache;
+  }
+
+  /**
+   * not_after is the expiry of the credential, as given to Insert().
+   */
+  bool Lookup(const std::string &fingerprint,
+              const std::string &membership_key,
+              StatusX509Validation *status, time_t *not_after);
+  void Insert(const std::string &fingerprint,
+              const std::string &membership_key,
+              StatusX509Validation status, time_t not_after);
+  void Clear() {m_entries.Clear();}
+
+ private:
+  /**
+   * Upper bound on the lifetime of an entry so that CRL updates and changes
+   * to the CA directory are eventually picked up.
+   */
+  static const time_t kMaxLifetime = 3600;
+  static const unsigned kCapacity = 256;
+
+  struct Decision {
+    StatusX509Validation status;
+    time_t not_after;
+  };
+
+  DecisionCache() : m_entries(kCapacity) {}
+  DecisionCache(const DecisionCache&);
+
+  LruCache<std::string, Decision> m_entries;
+
+  static DecisionCache *g_decision_cache;
+};
+
+
+struct CachedCredential {
+  std::string content;
+  std::string fingerprint;
+};
+
+/**
+ * Maps the identity of a credential file (see GetFileIdentity()) to its
+ * content and fingerprint, so that an unchanged file does not need to be read
+ * and hashed again.
+ */
+class CredentialFileCache {
+ public:
+  explicit CredentialFileCache(unsigned capacity) : m_entries(capacity) {}
+
+  const CachedCredential *Lookup(const FileIdentity &identity) {
+    return m_entries.Lookup(identity);
+  }
+  void Insert(const FileIdentity &identity, const CachedCredential &credential)
+  {
+    m_entries.Insert(identity, credential, time(NULL) + kMaxLifetime);
+  }
+
+ private:
+  static const time_t kMaxLifetime = 3600;
+
+  CredentialFileCache(const CredentialFileCache&);
+
+  LruCache<FileIdentity, CachedCredential> m_entries;
+};
+
+
+/**
+ * Remembers what was resolved for a requesting process, keyed by pid and
+ * start time so that a reused pid is not mistaken for a known process.
+ */
+class ProcessCache {
+ public:
+  static ProcessCache *GetInstance() {
+    if (!g_process_cache)
+      g_process_cache = new ProcessCache();
+    return g_process_cache;
+  }
+
+  const ProcessInfo *Lookup(const std::string &key) {
+    return m_entries.Lookup(key);
+  }
+  /**
+   * Entries are replaced when files are opened for the process but keep their
+   * original expiry.
+   */
+  void Insert(const ProcessInfo &info) {
+    m_entries.Insert(info.key, info, info.expiry);
+  }
+
+  /**
+   * Bounds the time for which a process that moved to another root
+   * directory or namespace keeps its old container identity.
+   */
+  static const time_t kMaxLifetime = 300;
+
+ private:
+  static const unsigned kCapacity = 1024;
+
+  ProcessCache() : m_entries(kCapacity) {}
+  ProcessCache(const ProcessCache&);
+
+  LruCache<std::string, ProcessInfo> m_entries;
+
+  static ProcessCache *g_process_cache;
+};
+
+
+/**
+ * Keeps the JSON body of successful replies, up to the trailing TTL, per
+ * credential fingerprint.  The body embeds the Base64 encoded proxy or the
+ * token, which then needs to be encoded only once per credential.
+ */
+class ReplyCache {
+ public:
+  static ReplyCache *GetInstance() {
+    if (!g_reply_cache)
+      g_reply_cache = new ReplyCache();
+    return g_reply_cache;
+  }
+
+  const std::string *Lookup(const std::string &fingerprint) {
+    return m_entries.Lookup(fingerprint);
+  }
+  const std::string *Insert(const std::string &fingerprint,
+                            const std::string &body)
+  {
+    return m_entries.Insert(fingerprint, body, time(NULL) + kMaxLifetime);
+  }
+
+ private:
+  static const time_t kMaxLifetime = 3600;
+  static const unsigned kCapacity = 64;
+
+  ReplyCache() : m_entries(kCapacity) {}
+  ReplyCache(const ReplyCache&);
+
+  LruCache<std::string, std::string> m_entries;
+
+  static ReplyCache *g_reply_cache;
+};
+
+
+/**
+ * Remembers credentials that were recently not found or found to be invalid,
+ * so that misconfigured jobs do not pay for the namespace switch, the read
+ * and the verification on every request.  Keys are built by the caller from
+ * the container identity (see GetContainerIdentity()), the uid and the
+ * resolved path.  Invalid entries additionally carry the identity of the
+ * rejected file and only match as long as the file is unchanged.  Entries
+ * expire after a short time, so that newly created credentials and trust
+ * store updates are picked up.
+ */
+class NegativeCache {
+ public:
+  static NegativeCache *GetInstance() {
+    if (!g_negative_cache)
+      g_negative_cache = new NegativeCache();
+    return g_negative_cache;
+  }
+
+  bool IsNotFound(const std::string &key);
+  /**
+   * On a hit, fingerprint is set to the one given to InsertInvalid().
+   */
+  bool IsInvalid(const std::string &key, const FileIdentity &identity,
+                 std::string *fingerprint);
+  void InsertNotFound(const std::string &key);
+  void InsertInvalid(const std::string &key, const FileIdentity &identity,
+                     const std::string &fingerprint);
+  void Clear() {m_entries.Clear();}
+
+ private:
+  static const time_t kNotFoundLifetime = 10;
+  static const time_t kInvalidLifetime = 60;
+  static const unsigned kCapacity = 256;
+
+  struct Entry {
+    Entry() : has_identity(false) {}
+    bool has_identity;
+    FileIdentity identity;
+    std::string fingerprint;
+  };
+
+  NegativeCache() : m_entries(kCapacity) {}
+  NegativeCache(const NegativeCache&);
+
+  LruCache<std::string, Entry> m_entries;
+
+  static NegativeCache *g_negative_cache;
+};
+
+#endif  // CVMFS_AUTHZ_X509_HELPER_CACHE_H_
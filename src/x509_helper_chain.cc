@@ -0,0 +1,188 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+#include "x509_helper_chain.h"
+
+#include <openssl/x509v3.h>
+
+#include <cstdlib>
+
+#include "x509_helper_digest.h"
+#include "x509_helper_log.h"
+#include "x509_helper_truststore.h"
+
+using namespace std;  // NOLINT
+
+
+time_t Asn1TimeToTime(const ASN1_TIME *asn1_time) {
+  int days, seconds;
+  if (!asn1_time || !ASN1_TIME_diff(&days, &seconds, NULL, asn1_time))
+    return 0;
+  return time(NULL) + static_cast<time_t>(days) * 86400 + seconds;
+}
+
+
+static string GetCertFingerprint(X509 *cert) {
+  unsigned char *der = NULL;
+  int der_len = i2d_X509(cert, &der);
+  if (der_len <= 0)
+    return "";
+  string fingerprint = Sha256(der, der_len);
+  OPENSSL_free(der);
+  return fingerprint;
+}
+
+
+static string GetNameString(X509_NAME *name) {
+  char *buf = X509_NAME_oneline(name, NULL, 0);
+  if (!buf)
+    return "";
+  string result(buf);
+  OPENSSL_free(buf);
+  return result;
+}
+
+
+static bool IsProxy(X509 *cert) {
+  return X509_get_extension_flags(cert) & EXFLAG_PROXY;
+}
+
+
+/**
+ * The subject of an RFC 3820 proxy is the subject of its issuer plus exactly
+ * one additional CN relative distinguished name.
+ */
+static bool IsProxyNameValid(X509 *proxy, X509 *issuer) {
+  X509_NAME *subject = X509_get_subject_name(proxy);
+  X509_NAME *issuer_subject = X509_get_subject_name(issuer);
+  const int nentries = X509_NAME_entry_count(subject);
+  if (nentries < 2 || nentries != X509_NAME_entry_count(issuer_subject) + 1)
+    return false;
+  X509_NAME_ENTRY *last = X509_NAME_get_entry(subject, nentries - 1);
+  if (OBJ_obj2nid(X509_NAME_ENTRY_get_object(last)) != NID_commonName)
+    return false;
+  if (X509_NAME_ENTRY_set(last) ==
+      X509_NAME_ENTRY_set(X509_NAME_get_entry(subject, nentries - 2)))
+  {
+    // Multi-valued RDN
+    return false;
+  }
+
+  X509_NAME *stripped = X509_NAME_dup(subject);
+  if (!stripped)
+    return false;
+  X509_NAME_ENTRY_free(X509_NAME_delete_entry(stripped, nentries - 1));
+  const bool result = (X509_NAME_cmp(stripped, issuer_subject) == 0);
+  X509_NAME_free(stripped);
+  return result;
+}
+
+
+/**
+ * Checks a single proxy certificate against its issuer.  proxies_below is the
+ * number of proxy certificates issued further down the chain.
+ */
+static bool IsProxyLayerValid(X509 *proxy, X509 *issuer, int proxies_below) {
+  const uint32_t flags = X509_get_extension_flags(proxy);
+  if (flags & (EXFLAG_INVALID | EXFLAG_CRITICAL))
+    return false;
+  if (X509_check_ca(proxy) != 0 || X509_check_ca(issuer) != 0)
+    return false;
+  if (X509_check_issued(issuer, proxy) != X509_V_OK)
+    return false;
+  if ((X509_cmp_current_time(X509_get0_notBefore(proxy)) >= 0) ||
+      (X509_cmp_current_time(X509_get0_notAfter(proxy)) <= 0))
+  {
+    LogAuthz(kLogAuthzDebug, "proxy certificate not within validity period");
+    return false;
+  }
+  if (!IsProxyNameValid(proxy, issuer)) {
+    LogAuthz(kLogAuthzDebug, "proxy subject does not extend issuer subject");
+    return false;
+  }
+
+  PROXY_CERT_INFO_EXTENSION *info = reinterpret_cast<
+    PROXY_CERT_INFO_EXTENSION *>(
+      X509_get_ext_d2i(proxy, NID_proxyCertInfo, NULL, NULL));
+  if (!info)
+    return false;
+  bool result = true;
+  if (info->pcPathLengthConstraint &&
+      (ASN1_INTEGER_get(info->pcPathLengthConstraint) < proxies_below))
+  {
+    LogAuthz(kLogAuthzDebug, "proxy path length constraint violated");
+    result = false;
+  }
+  PROXY_CERT_INFO_EXTENSION_free(info);
+  if (!result)
+    return false;
+
+  EVP_PKEY *issuer_key = X509_get0_pubkey(issuer);
+  return issuer_key && (X509_verify(proxy, issuer_key) == 1);
+}
+
+
+bool VerifiedChainCache::VerifyProxyLayers(X509 *cert, STACK_OF(X509) *chain)
+{
+  X509 *current = cert;
+  int idx = 0;
+  int nproxies = 0;
+  while (IsProxy(current)) {
+    if (idx >= sk_X509_num(chain))
+      return false;
+    X509 *issuer = sk_X509_value(chain, idx++);
+    if (!IsProxyLayerValid(current, issuer, nproxies))
+      return false;
+    nproxies++;
+    current = issuer;
+  }
+  if (nproxies == 0)
+    return false;
+
+  const Link *link = m_links.Lookup(GetCertFingerprint(current));
+  if (link == NULL)
+    return false;
+  // Revocation checks are index lookups, so the intermediate certificates
+  // that came along with the proxy are checked as well.
+  TrustStore *trust_store = TrustStore::GetInstance();
+  if (trust_store->IsRevoked(current)) {
+    LogAuthz(kLogAuthzDebug, "%s has been revoked", link->subject.c_str());
+    return false;
+  }
+  for (; idx < sk_X509_num(chain); ++idx) {
+    if (trust_store->IsRevoked(sk_X509_value(chain, idx))) {
+      LogAuthz(kLogAuthzDebug, "issuer of %s has been revoked",
+               link->subject.c_str());
+      return false;
+    }
+  }
+  LogAuthz(kLogAuthzDebug, "verified %d proxy layers on top of %s (%s)",
+           nproxies, link->subject.c_str(), link->issuer.c_str());
+  return true;
+}
+
+
+void VerifiedChainCache::Remember(STACK_OF(X509) *verified_path) {
+  const int length = sk_X509_num(verified_path);
+  // Every link is valid only as long as all certificates above it
+  time_t not_after = time(NULL) + kMaxLifetime;
+  for (int i = length - 1; i >= 0; --i) {
+    X509 *cert = sk_X509_value(verified_path, i);
+    const time_t cert_not_after = Asn1TimeToTime(X509_get0_notAfter(cert));
+    if (cert_not_after < not_after)
+      not_after = cert_not_after;
+    if (IsProxy(cert) || (i == length - 1))
+      continue;
+
+    Link link;
+    link.subject = GetNameString(X509_get_subject_name(cert));
+    link.issuer =
+      GetNameString(X509_get_subject_name(sk_X509_value(verified_path, i+1)));
+    const string fingerprint = GetCertFingerprint(cert);
+    if (fingerprint.empty() || (not_after <= time(NULL)))
+      continue;
+    m_links.Insert(fingerprint, link, not_after);
+  }
+}
+
+VerifiedChainCache *VerifiedChainCache::g_chain_cache = NULL;
@@ -0,0 +1,71 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_AUTHZ_X509_HELPER_CHAIN_H_
+#define CVMFS_AUTHZ_X509_HELPER_CHAIN_H_
+
+#include <openssl/x509.h>
+#include <time.h>
+
+#include <string>
+
+#include "x509_helper_lru.h"
+
+/**
+ * Converts an ASN.1 time into seconds since the epoch.  Returns 0 if the time
+ * cannot be interpreted, which makes the certificate look expired.
+ */
+time_t Asn1TimeToTime(const ASN1_TIME *asn1_time);
+
+/**
+ * Remembers the non-proxy certificates (EEC and CAs) of chains that Globus
+ * verified up to a trust anchor, keyed by the SHA-256 of their DER encoding.
+ * A fresh proxy on top of such a certificate only needs its own RFC 3820
+ * proxy layers checked, which avoids a full chain verification right after
+ * proxy renewals.  Known certificates are still checked against the CRLs of
+ * the trust store on every use.
+ */
+class VerifiedChainCache {
+ public:
+  static VerifiedChainCache *GetInstance() {
+    if (!g_chain_cache)
+      g_chain_cache = new VerifiedChainCache();
+    return g_chain_cache;
+  }
+
+  /**
+   * Returns true if cert is a chain of RFC 3820 proxies on top of an already
+   * verified certificate and all proxy layers are valid.  A false return
+   * value means that the chain needs a full verification.
+   */
+  bool VerifyProxyLayers(X509 *cert, STACK_OF(X509) *chain);
+  /**
+   * Records the links of a verified path, ordered from the leaf certificate
+   * to the trust anchor.
+   */
+  void Remember(STACK_OF(X509) *verified_path);
+  void Clear() {m_links.Clear();}
+
+ private:
+  /**
+   * Upper bound on the lifetime of a verified link so that revocations are
+   * picked up.
+   */
+  static const time_t kMaxLifetime = 3600;
+  static const unsigned kCapacity = 128;
+
+  struct Link {
+    std::string issuer;
+    std::string subject;
+  };
+
+  VerifiedChainCache() : m_links(kCapacity) {}
+  VerifiedChainCache(const VerifiedChainCache&);
+
+  LruCache<std::string, Link> m_links;
+
+  static VerifiedChainCache *g_chain_cache;
+};
+
+#endif  // CVMFS_AUTHZ_X509_HELPER_CHAIN_H_
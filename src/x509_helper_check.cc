@@ -4,15 +4,24 @@
 #include "x509_helper_check.h"
 
 #include <alloca.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
 #include <sys/types.h>
+#include <time.h>
 
 #include <cassert>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <vector>
 
+#include "x509_helper_cache.h"
+#include "x509_helper_chain.h"
 #include "x509_helper_globus.h"
 #include "x509_helper_log.h"
+#include "x509_helper_membership.h"
+#include "x509_helper_openssl.h"
+#include "x509_helper_truststore.h"
 #include "x509_helper_voms.h"
 
 using namespace std;  // NOLINT
@@ -23,112 +32,201 @@ namespace {
 /**
  * Create the VOMS data structure to the best of our abilities.
  *
- * Resulting memory is owned by caller and must be destroyed with VOMS_Destroy.
+ * Resulting memory is owned by caller and must be deleted.
  */
 struct authz_state {
-  FILE *m_fp;
-  struct vomsdata *m_voms;
   globus_gsi_cred_handle_t m_cred;
   BIO *m_bio;
   X509 *m_cert;
   EVP_PKEY *m_pkey;
   STACK_OF(X509) *m_chain;
-  char *m_subject;
   globus_gsi_callback_data_t m_callback;
 
   authz_state() :
-    m_fp(NULL),
-    m_voms(NULL),
     m_cred(NULL),
     m_bio(NULL),
     m_cert(NULL),
     m_pkey(NULL),
     m_chain(NULL),
-    m_subject(NULL),
     m_callback(NULL)
   {}
 
   ~authz_state() {
-    if (m_fp) {fclose(m_fp);}
-    if (m_voms) {(*g_VOMS_Destroy)(m_voms);}
-    if (m_cred) {(*g_globus_gsi_cred_handle_destroy)(m_cred);}
+    if (m_cred) {GlobusLib::GetInstance()->RetireCredHandle(m_cred);}
     if (m_bio) {BIO_free(m_bio);}
     if (m_cert) {X509_free(m_cert);}
     if (m_pkey) {EVP_PKEY_free(m_pkey);}
     if (m_chain) {sk_X509_pop_free(m_chain, X509_free);}
-    if (m_subject) {OPENSSL_free(m_subject);}
-    if (m_callback) {(*g_globus_gsi_callback_data_destroy)(m_callback);}
+    if (m_callback) {GlobusLib::GetInstance()->RetireCallback(m_callback);}
   }
 };
 
 }  // anonymous namespace
 
 
-static authz_data *GenerateVOMSData(FILE *fp_proxy) {
-  authz_state state;
-  state.m_fp = fp_proxy;
+/**
+ * Earliest notAfter of the certificate and its chain.
+ */
+static time_t GetChainNotAfter(X509 *cert, STACK_OF(X509) *chain) {
+  time_t not_after = Asn1TimeToTime(X509_get0_notAfter(cert));
+  for (int i = 0; i < sk_X509_num(chain); ++i) {
+    time_t cert_not_after =
+      Asn1TimeToTime(X509_get0_notAfter(sk_X509_value(chain, i)));
+    if (cert_not_after < not_after)
+      not_after = cert_not_after;
+  }
+  return not_after;
+}
 
-  // Start of Globus proxy parsing and verification...
-  globus_result_t result =
-      (*g_globus_gsi_cred_handle_init)(&state.m_cred, NULL);
+
+/**
+ * Full verification of the credential chain by Globus.  On success, the
+ * verified path is recorded in the chain cache.
+ */
+static bool VerifyCertChain(authz_state *state) {
+  // Pooled callback objects already know the certificates directory.
+  state->m_callback = GlobusLib::GetInstance()->AcquireCallback();
+  if (!state->m_callback)
+    return false;
+
+  // Verify credential chain.
+  globus_result_t result = (*g_globus_gsi_cred_verify_cert_chain)(state->m_cred,
+                                                  state->m_callback);
   if (GLOBUS_SUCCESS != result) {
+    LogAuthz(kLogAuthzDebug, "Failed to validate credentials");
     GlobusLib::GetInstance()->PrintError(result);
+    return false;
+  }
+
+  STACK_OF(X509) *verified_path = NULL;
+  result = (*g_globus_gsi_callback_get_cert_chain)(state->m_callback,
+                                                   &verified_path);
+  if (GLOBUS_SUCCESS == result) {
+    VerifiedChainCache::GetInstance()->Remember(verified_path);
+    sk_X509_pop_free(verified_path, X509_free);
+  }
+  return true;
+}
+
+
+/**
+ * The part of the authz data that does not depend on the backend.
+ */
+static authz_data *AssembleAuthzData(X509 *cert, STACK_OF(X509) *chain,
+                                     X509 *eec_cert)
+{
+  // From the EEC, use OpenSSL to determine the subject
+  char *dn = X509_NAME_oneline(X509_get_subject_name(eec_cert), NULL, 0);
+  if (!dn) {
+    LogAuthz(kLogAuthzDebug, "Unable to determine certificate DN.");
     return NULL;
   }
 
-  state.m_bio = BIO_new_fp(state.m_fp, 0);
+  authz_data *authz = new authz_data();
+  authz->not_after_ = GetChainNotAfter(cert, chain);
+  if (!VomsLib::GetInstance()->GetAttributes(cert, chain, eec_cert,
+                                             &authz->fqans_,
+                                             &authz->not_after_))
+  {
+    OPENSSL_free(dn);
+    delete authz;
+    return NULL;
+  }
+  authz->dn_ = strdup(dn);
+  authz->subject_ = dn;
+  OPENSSL_free(dn);
+  return authz;
+}
+
+
+static authz_data *GenerateVOMSDataOpenSsl(const string &proxy) {
+  authz_state state;
+
+  state.m_bio = BIO_new_mem_buf(proxy.data(), proxy.size());
   if (!state.m_bio) {
     LogAuthz(kLogAuthzDebug, "Unable to allocate new BIO object");
     return NULL;
   }
-
-  result = (*g_globus_gsi_cred_read_proxy_bio)(state.m_cred, state.m_bio);
-  if (GLOBUS_SUCCESS != result) {
+  if (!ReadProxyPem(state.m_bio, &state.m_cert, &state.m_pkey,
+                    &state.m_chain))
+  {
     LogAuthz(kLogAuthzDebug, "Failed to parse credentials");
-    GlobusLib::GetInstance()->PrintError(result);
+    return NULL;
+  }
+  if (!X509_check_private_key(state.m_cert, state.m_pkey)) {
+    LogAuthz(kLogAuthzDebug, "Process certificate and key do not match");
+    return NULL;
+  }
+  X509 *eec_cert = GetIdentityCert(state.m_cert, state.m_chain);
+  if (!eec_cert) {
+    LogAuthz(kLogAuthzDebug, "No end entity certificate in the chain");
     return NULL;
   }
 
-  // Setup Globus callback object.
-  result = (*g_globus_gsi_callback_data_init)(&state.m_callback);
-  if (GLOBUS_SUCCESS != result) {
-    GlobusLib::GetInstance()->PrintError(result);
+  // Only the proxy layers need checking if the rest was verified before
+  if (!VerifiedChainCache::GetInstance()->VerifyProxyLayers(state.m_cert,
+                                                            state.m_chain))
+  {
+    if (!VerifyProxyChain(state.m_cert, state.m_chain))
+      return NULL;
+  }
+
+  return AssembleAuthzData(state.m_cert, state.m_chain, eec_cert);
+}
+
+
+static authz_data *GenerateVOMSDataGlobus(const string &proxy) {
+  authz_state state;
+  if (!GlobusLib::GetInstance()->IsValid()) {
+    LogAuthz(kLogAuthzDebug, "Globus library not available");
     return NULL;
   }
-  char *cert_dir;
-  result = (*g_globus_gsi_sysconfig_get_cert_dir_unix)(&cert_dir);
-  if (GLOBUS_SUCCESS != result) {
-    LogAuthz(kLogAuthzDebug,
-             "Failed to determine trusted certificates directory.");
-    GlobusLib::GetInstance()->PrintError(result);
+
+  // Start of Globus proxy parsing and verification...
+  state.m_cred = GlobusLib::GetInstance()->AcquireCredHandle();
+  if (!state.m_cred)
+    return NULL;
+
+  state.m_bio = BIO_new_mem_buf(proxy.data(), proxy.size());
+  if (!state.m_bio) {
+    LogAuthz(kLogAuthzDebug, "Unable to allocate new BIO object");
     return NULL;
   }
-  result = (*g_globus_gsi_callback_set_cert_dir)(state.m_callback, cert_dir);
-  free(cert_dir);
+
+  globus_result_t result =
+    (*g_globus_gsi_cred_read_proxy_bio)(state.m_cred, state.m_bio);
   if (GLOBUS_SUCCESS != result) {
+    LogAuthz(kLogAuthzDebug, "Failed to parse credentials");
     GlobusLib::GetInstance()->PrintError(result);
     return NULL;
   }
 
-  // Verify credential chain.
-  result = (*g_globus_gsi_cred_verify_cert_chain)(state.m_cred,
-                                                  state.m_callback);
+  // Load certificate and chain from Globus handle
+  result = (*g_globus_gsi_cred_get_cert)(state.m_cred, &state.m_cert);
   if (GLOBUS_SUCCESS != result) {
-    LogAuthz(kLogAuthzDebug, "Failed to validate credentials");
+    LogAuthz(kLogAuthzDebug, "Failed to get process certificate.");
     GlobusLib::GetInstance()->PrintError(result);
     return NULL;
   }
-
-  // Load key and certificate from Globus handle
-  result = (*g_globus_gsi_cred_get_key)(state.m_cred, &state.m_pkey);
+  result = (*g_globus_gsi_cred_get_cert_chain)(state.m_cred, &state.m_chain);
   if (GLOBUS_SUCCESS != result) {
-    LogAuthz(kLogAuthzDebug, "Failed to get process private key.");
+    LogAuthz(kLogAuthzDebug, "Process does not have cert chain.");
     GlobusLib::GetInstance()->PrintError(result);
     return NULL;
   }
-  result = (*g_globus_gsi_cred_get_cert)(state.m_cred, &state.m_cert);
+
+  // Only the proxy layers need checking if the rest was verified before
+  if (!VerifiedChainCache::GetInstance()->VerifyProxyLayers(state.m_cert,
+                                                            state.m_chain))
+  {
+    if (!VerifyCertChain(&state))
+      return NULL;
+  }
+
+  // Load key from Globus handle
+  result = (*g_globus_gsi_cred_get_key)(state.m_cred, &state.m_pkey);
   if (GLOBUS_SUCCESS != result) {
-    LogAuthz(kLogAuthzDebug, "Failed to get process certificate.");
+    LogAuthz(kLogAuthzDebug, "Failed to get process private key.");
     GlobusLib::GetInstance()->PrintError(result);
     return NULL;
   }
@@ -139,14 +237,6 @@ static authz_data *GenerateVOMSData(FILE *fp_proxy) {
     return NULL;
   }
 
-  // Load certificate chain
-  result = (*g_globus_gsi_cred_get_cert_chain)(state.m_cred, &state.m_chain);
-  if (GLOBUS_SUCCESS != result) {
-    LogAuthz(kLogAuthzDebug, "Process does not have cert chain.");
-    GlobusLib::GetInstance()->PrintError(result);
-    return NULL;
-  }
-
   // Look through certificates to find an EEC (which has the subject)
   globus_gsi_cert_utils_cert_type_t cert_type;
   X509 *eec_cert = state.m_cert;
@@ -163,178 +253,129 @@ static authz_data *GenerateVOMSData(FILE *fp_proxy) {
       return NULL;
     }
   }
-  // From the EEC, use OpenSSL to determine the subject
-  char *dn = X509_NAME_oneline(X509_get_subject_name(eec_cert), NULL, 0);
-  if (!dn) {
-    LogAuthz(kLogAuthzDebug, "Unable to determine certificate DN.");
-    return NULL;
-  }
-  state.m_subject = strdup(dn);
-  OPENSSL_free(dn);
-
-  state.m_voms = (*g_VOMS_Init)(NULL, NULL);
-  if (!state.m_voms) {
-    return NULL;
-  }
-
-  int voms_error = 0;
-  const int retval = (*g_VOMS_Retrieve)(state.m_cert, state.m_chain,
-                                        RECURSE_CHAIN,
-                                        state.m_voms, &voms_error);
-  // If there is no VOMS extension (VERR_NOEXT), this shouldn't be fatal.
-  if (!retval && (voms_error != VERR_NOEXT)) {
-    char *err_str = (*g_VOMS_ErrorMessage)(state.m_voms, voms_error, NULL, 0);
-    LogAuthz(kLogAuthzDebug, "Unable to parse VOMS file: %s\n", err_str);
-    free(err_str);
-    return NULL;
-  }
-
-  // Move pointers to returned authz_data structure
-  authz_data *authz = new authz_data();
-  authz->dn_ = state.m_subject;
-  state.m_subject = NULL;
-  if (voms_error != VERR_NOEXT) {
-    authz->voms_ = state.m_voms;
-    state.m_voms = NULL;
-  }
-  return authz;
+  return AssembleAuthzData(state.m_cert, state.m_chain, eec_cert);
 }
 
 
-static void
-SplitGroupToPaths(const string &group, vector<string> *hierarchy) {
-  size_t start = 0, end = 0;
-  while ((end = group.find('/', start)) != std::string::npos) {
-    if (end-start) {
-      hierarchy->push_back(group.substr(start, end-start));
-    }
-    start = end + 1;
-  }
-  if (start != group.size()-1) {hierarchy->push_back(group.substr(start));}
+static authz_data *GenerateVOMSData(const string &proxy) {
+  if (GetX509Backend() == kX509BackendOpenSsl)
+    return GenerateVOMSDataOpenSsl(proxy);
+  return GenerateVOMSDataGlobus(proxy);
 }
 
 
-static bool
-IsSubgroupOf(const vector<string> &group1, const vector<string> &group2) {
-  if (group1.size() < group2.size()) {
-    return false;
-  }
-  vector<string>::const_iterator it1 = group1.begin();
-  for (vector<string>::const_iterator it2 = group2.begin();
-       it2 != group2.end();
-       it1++, it2++)
+/**
+ * Structural checks that reject obviously unusable proxies before any
+ * handle is set up or signature verified: the file must start with the
+ * proxy certificate, contain a private key, not have more certificates than
+ * kMaxChainDepth, and the proxy certificate must be valid now.
+ */
+static bool PrescreenProxy(const string &proxy) {
+  const unsigned kMaxChainDepth = 16;
+  const string kBegin = "-----BEGIN ";
+  const string kBeginCert = "-----BEGIN CERTIFICATE-----";
+
+  unsigned nblocks = 0;
+  unsigned ncerts = 0;
+  bool has_key = false;
+  size_t first_block = string::npos;
+  for (size_t pos = proxy.find(kBegin); pos != string::npos;
+       pos = proxy.find(kBegin, pos + kBegin.length()))
   {
-    if (*it1 != *it2) {return false;}
+    if (first_block == string::npos)
+      first_block = pos;
+    if (++nblocks > kMaxChainDepth + 1) {
+      LogAuthz(kLogAuthzDebug, "proxy has too many PEM blocks");
+      return false;
+    }
+    if (proxy.compare(pos, kBeginCert.length(), kBeginCert) == 0) {
+      ncerts++;
+    } else {
+      const size_t eol = proxy.find("-----", pos + kBegin.length());
+      if ((eol != string::npos) &&
+          (proxy.substr(pos, eol - pos).find("PRIVATE KEY") != string::npos))
+      {
+        has_key = true;
+      }
+    }
   }
-  return true;
-}
-
-
-static bool
-IsRoleMatching(const char *role1, const char *role2) {
-  if ((role2 == NULL) || (strlen(role2) == 0) ||
-      !strcmp(role2, "NULL"))
+  if ((ncerts == 0) || !has_key || (ncerts > kMaxChainDepth) ||
+      (proxy.compare(first_block, kBeginCert.length(), kBeginCert) != 0))
   {
-    return true;
+    LogAuthz(kLogAuthzDebug, "proxy does not have the expected structure");
+    return false;
   }
-  if ((role1 == NULL) || !strcmp(role1, "NULL")) {return false;}
 
-  return !strcmp(role1, role2);
-}
-
-
-static bool
-CheckSingleAuthz(const authz_data *authz_ptr, const string &authz) {
-  // An empty entry should authorize nobody.
-  if (authz.empty()) {return false;}
-
-  // Break the authz into VOMS VO, groups, and roles.
-  // We will compare the required auth against the cached session VOMS info.
-  // Roles must match exactly; Sub-groups are authorized in their parent
-  // group.
-  std::string vo, role, group;
-  bool is_dn = false;
-  if (authz[0] != '/') {
-    size_t delim = authz.find(':');
-    if (delim != std::string::npos) {
-      vo = authz.substr(0, delim);
-      size_t delim2 = authz.find("/Role=", delim+1);
-      if (delim2 != std::string::npos) {
-        role = authz.substr(delim2 + 6);
-        group = authz.substr(delim + 1, delim2 - delim - 1);
-      } else {
-        group = authz.substr(delim + 1);;
-      }
-    }
-  } else {
-    // No VOMS info in the authz; it is a DN.
-    is_dn = true;
+  BIO *bio = BIO_new_mem_buf(proxy.data() + first_block,
+                             proxy.size() - first_block);
+  X509 *leaf = bio ? PEM_read_bio_X509(bio, NULL, NULL, NULL) : NULL;
+  BIO_free(bio);
+  ERR_clear_error();
+  if (!leaf) {
+    LogAuthz(kLogAuthzDebug, "cannot decode proxy certificate");
+    return false;
   }
-  // Quick sanity check of group name.
-  if (!group.empty() && group[0] != '/') {return false;}
+  const bool is_current =
+    (X509_cmp_current_time(X509_get0_notBefore(leaf)) < 0) &&
+    (X509_cmp_current_time(X509_get0_notAfter(leaf)) > 0);
+  X509_free(leaf);
+  if (!is_current)
+    LogAuthz(kLogAuthzDebug, "proxy certificate is expired or not yet valid");
+  return is_current;
+}
 
-  vector<string> group_hierarchy;
-  SplitGroupToPaths(group, &group_hierarchy);
 
-  // Now we have valid data, check authz.
-  // First, check if it is a valid DN.
-  if (is_dn) {
-    return !strcmp(authz.c_str(), authz_ptr->dn_);
-  }
-  // If there is no VOMS info, return immediately..
-  if (!authz_ptr->voms_) {return false;}
-  // Iterator through the VOs
-  for (int idx=0; authz_ptr->voms_->data[idx] != NULL; idx++) {
-    struct voms *it = authz_ptr->voms_->data[idx];
-    if (!it->voname) {continue;}
-    if (strcmp(vo.c_str(), it->voname)) {continue;}
-
-    // Iterate through the FQANs.
-    for (int idx2=0; it->std[idx2] != NULL; idx2++) {
-      struct data *it2 = it->std[idx2];
-      if (!it2->group) {continue;}
-      LogAuthz(kLogAuthzDebug, "Checking (%s Role=%s) against group"
-               " %s, role %s.", group.c_str(), role.c_str(), it2->group,
-               it2->role);
-      vector<string> avail_hierarchy;
-      SplitGroupToPaths(it2->group, &avail_hierarchy);
-      if (IsSubgroupOf(avail_hierarchy, group_hierarchy) &&
-          IsRoleMatching(it2->role, role.c_str()))
-      {
-        return true;
-      }
-    }
+X509Backend GetX509Backend() {
+  static int backend = -1;
+  if (backend < 0) {
+    const char *name = getenv("CVMFS_X509_BACKEND");
+    backend = (name && (strcmp(name, "openssl") == 0)) ?
+              kX509BackendOpenSsl : kX509BackendGlobus;
   }
-
-  return false;
+  return static_cast<X509Backend>(backend);
 }
 
 
-static bool
-CheckMultipleAuthz(const authz_data *authz_ptr,
-                   const string &authz_list)
+StatusX509Validation CheckX509Proxy(const MembershipRules &membership,
+                                    const string &fingerprint,
+                                    const string &proxy,
+                                    time_t *not_after)
 {
-  // Check all authorizations against our information
-  size_t last_delim = 0;
-  size_t delim = authz_list.find('\n');
-  while (delim != std::string::npos) {
-    std::string next_authz = authz_list.substr(last_delim, delim-last_delim);
-    last_delim = delim + 1;
-    delim = authz_list.find('\n', last_delim);
-
-    if (CheckSingleAuthz(authz_ptr, next_authz)) {return true;}
+  *not_after = 0;
+  // Changed CAs invalidate the verified chains, changed CRLs only the
+  // decisions; known chains are checked against the CRLs anyway.
+  const unsigned changes = TrustStore::GetInstance()->Refresh();
+  if (changes & kTrustStoreCasChanged)
+    VerifiedChainCache::GetInstance()->Clear();
+  if ((changes & kTrustStoreDirReplaced) &&
+      (GetX509Backend() == kX509BackendGlobus))
+  {
+    GlobusLib::GetInstance()->InvalidateCertDir();
+  }
+  if (changes != kTrustStoreUnchanged) {
+    DecisionCache::GetInstance()->Clear();
+    NegativeCache::GetInstance()->Clear();
   }
-  std::string next_authz = authz_list.substr(last_delim);
-  return CheckSingleAuthz(authz_ptr, next_authz);
-}
 
+  StatusX509Validation status;
+  if (DecisionCache::GetInstance()->Lookup(fingerprint, membership.key(),
+                                           &status, not_after))
+  {
+    LogAuthz(kLogAuthzDebug, "using cached decision %d", status);
+    return status;
+  }
 
-StatusX509Validation CheckX509Proxy(const string &membership, FILE *fp_proxy) {
-  authz_data *voms_data = GenerateVOMSData(fp_proxy);
+  if (!PrescreenProxy(proxy))
+    return kCheckX509Invalid;
+  authz_data *voms_data = GenerateVOMSData(proxy);
   if (voms_data == NULL)
     return kCheckX509Invalid;
   LogAuthz(kLogAuthzDebug, "Checking proxy subject %s", voms_data->dn_);
-  const bool result = CheckMultipleAuthz(voms_data, membership);
+  const bool result = membership.Matches(*voms_data);
+  status = result ? kCheckX509Good : kCheckX509NotMember;
+  DecisionCache::GetInstance()->Insert(fingerprint, membership.key(), status,
+                                       voms_data->not_after_);
+  *not_after = voms_data->not_after_;
   delete voms_data;
-  return result ? kCheckX509Good : kCheckX509NotMember;
+  return status;
 }
@@ -5,16 +5,39 @@
 #ifndef CVMFS_AUTHZ_X509_HELPER_CHECK_H_
 #define CVMFS_AUTHZ_X509_HELPER_CHECK_H_
 
-#include <cstdio>
+#include <time.h>
+
 #include <string>
 
+class MembershipRules;
+
 enum StatusX509Validation {
   kCheckX509Good,
   kCheckX509Invalid,
   kCheckX509NotMember,
 };
 
-StatusX509Validation CheckX509Proxy(const std::string &membership,
-                                    FILE *fp_proxy);
+enum X509Backend {
+  kX509BackendGlobus,
+  kX509BackendOpenSsl,
+};
+
+/**
+ * Proxies are verified by Globus unless CVMFS_X509_BACKEND=openssl selects
+ * the native OpenSSL verification (see x509_helper_openssl.h), in which case
+ * the Globus libraries are not loaded at all.
+ */
+X509Backend GetX509Backend();
+
+/**
+ * The proxy is the content of the proxy file.  The fingerprint is its
+ * SHA-256; it is used to look up previous decisions for the same credential.
+ * For verified proxies, not_after is set to the earliest expiry of any
+ * certificate or attribute certificate in the chain, otherwise to 0.
+ */
+StatusX509Validation CheckX509Proxy(const MembershipRules &membership,
+                                    const std::string &fingerprint,
+                                    const std::string &proxy,
+                                    time_t *not_after);
 
 #endif  // CVMFS_AUTHZ_X509_HELPER_CHECK_H_
@@ -0,0 +1,24 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "x509_helper_digest.h"
+
+#include <openssl/evp.h>
+
+#include <cassert>
+
+using namespace std;  // NOLINT
+
+string Sha256(const void *data, size_t size) {
+  unsigned char digest[EVP_MAX_MD_SIZE];
+  unsigned int digest_len = 0;
+  int retval = EVP_Digest(data, size, digest, &digest_len, EVP_sha256(), NULL);
+  assert(retval == 1);
+  return string(reinterpret_cast<char *>(digest), digest_len);
+}
+
+
+string Sha256(const string &data) {
+  return Sha256(data.data(), data.length());
+}
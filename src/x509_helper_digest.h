@@ -0,0 +1,18 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_AUTHZ_X509_HELPER_DIGEST_H_
+#define CVMFS_AUTHZ_X509_HELPER_DIGEST_H_
+
+#include <cstddef>
+#include <string>
+
+/**
+ * Raw (binary) SHA-256 digests, used as cache keys for credentials and
+ * membership lists.
+ */
+std::string Sha256(const void *data, size_t size);
+std::string Sha256(const std::string &data);
+
+#endif  // CVMFS_AUTHZ_X509_HELPER_DIGEST_H_
@@ -0,0 +1,148 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+#include "x509_helper_dn.h"
+
+#include <cctype>
+
+#include <algorithm>
+
+using namespace std;  // NOLINT
+
+
+/**
+ * Length of the attribute type at pos followed by '=', or 0 if there is none.
+ * Types are keywords (RFC 4514), i.e. a letter followed by letters, digits
+ * and hyphens.
+ */
+static size_t GetAttributeTypeLength(const string &dn, size_t pos) {
+  if ((pos >= dn.length()) || !isalpha(static_cast<unsigned char>(dn[pos])))
+    return 0;
+  size_t end = pos + 1;
+  while ((end < dn.length()) &&
+         (isalnum(static_cast<unsigned char>(dn[end])) || (dn[end] == '-')))
+  {
+    ++end;
+  }
+  return ((end < dn.length()) && (dn[end] == '=')) ? end - pos : 0;
+}
+
+
+void AddDnRule(const string &rule, vector<string> *dns) {
+  string dn = rule;
+  if (!dn.empty() && (dn[dn.length() - 1] == '\r'))
+    dn.erase(dn.length() - 1);
+  dns->push_back(dn);
+
+  // A '/' starts an RDN if it is followed by "<type>=" and the value of the
+  // previous RDN is not empty; otherwise it belongs to the value
+  string normalized;
+  bool has_alias = false;
+  size_t pos = 0;
+  while (pos < dn.length()) {
+    const size_t type_length = GetAttributeTypeLength(dn, pos + 1);
+    const string type = dn.substr(pos + 1, type_length);
+    if ((type == "Email") || (type == "E")) {
+      normalized += "/emailAddress";
+      has_alias = true;
+    } else {
+      normalized += "/" + type;
+    }
+    const size_t value_start = pos + 1 + type_length;
+    size_t value_end = dn.find('/', value_start + 2);
+    while ((value_end != string::npos) &&
+           (GetAttributeTypeLength(dn, value_end + 1) == 0))
+    {
+      value_end = dn.find('/', value_end + 1);
+    }
+    if (value_end == string::npos)
+      value_end = dn.length();
+    normalized += dn.substr(value_start, value_end - value_start);
+    pos = value_end;
+  }
+  if (has_alias)
+    dns->push_back(normalized);
+}
+
+
+/**
+ * 64 bit FNV-1a.  The DNs come from the repository policy and the verified
+ * EEC, so there is no need for a keyed hash.
+ */
+uint64_t DnSet::Hash(const string &dn) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (unsigned i = 0; i < dn.length(); ++i) {
+    hash ^= static_cast<unsigned char>(dn[i]);
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+
+void DnSet::Build(const vector<string> &dns) {
+  m_dns = dns;
+  sort(m_dns.begin(), m_dns.end());
+  m_dns.erase(unique(m_dns.begin(), m_dns.end()), m_dns.end());
+
+  uint32_t nslots = 2;
+  while (nslots < 2 * m_dns.size())
+    nslots *= 2;
+  Slot empty;
+  empty.hash = 0;
+  empty.index = kEmptySlot;
+  m_slots.assign(nslots, empty);
+
+  // 16 bits per DN keeps the false positive rate of the two probes below 2%
+  m_bloom.clear();
+  m_bloom_mask = 0;
+  if (m_dns.size() >= kBloomThreshold) {
+    uint64_t nbits = 64;
+    while (nbits < 16 * m_dns.size())
+      nbits *= 2;
+    m_bloom.assign(nbits / 64, 0);
+    m_bloom_mask = nbits - 1;
+  }
+
+  for (uint32_t i = 0; i < m_dns.size(); ++i) {
+    const uint64_t hash = Hash(m_dns[i]);
+    uint32_t slot = hash & (nslots - 1);
+    while (m_slots[slot].index != kEmptySlot)
+      slot = (slot + 1) & (nslots - 1);
+    m_slots[slot].hash = hash;
+    m_slots[slot].index = i;
+    if (m_bloom_mask) {
+      const uint64_t bit1 = (hash >> 32) & m_bloom_mask;
+      const uint64_t bit2 = (hash >> 13) & m_bloom_mask;
+      m_bloom[bit1 / 64] |= 1ULL << (bit1 % 64);
+      m_bloom[bit2 / 64] |= 1ULL << (bit2 % 64);
+    }
+  }
+}
+
+
+bool DnSet::MaybeContains(uint64_t hash) const {
+  if (m_bloom_mask == 0)
+    return true;
+  const uint64_t bit1 = (hash >> 32) & m_bloom_mask;
+  const uint64_t bit2 = (hash >> 13) & m_bloom_mask;
+  return (m_bloom[bit1 / 64] & (1ULL << (bit1 % 64))) &&
+         (m_bloom[bit2 / 64] & (1ULL << (bit2 % 64)));
+}
+
+
+bool DnSet::Contains(const string &dn) const {
+  if (m_dns.empty())
+    return false;
+  const uint64_t hash = Hash(dn);
+  if (!MaybeContains(hash))
+    return false;
+  const uint32_t nslots = m_slots.size();
+  for (uint32_t slot = hash & (nslots - 1);
+       m_slots[slot].index != kEmptySlot;
+       slot = (slot + 1) & (nslots - 1))
+  {
+    if ((m_slots[slot].hash == hash) && (m_dns[m_slots[slot].index] == dn))
+      return true;
+  }
+  return false;
+}
@@ -0,0 +1,60 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_AUTHZ_X509_HELPER_DN_H_
+#define CVMFS_AUTHZ_X509_HELPER_DN_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+/**
+ * Adds the spellings of a DN rule of a membership list to dns; the subject
+ * of a credential (OpenSSL "oneline" form, e.g. /DC=org/CN=Alice) matches the
+ * rule if it equals one of them.  The rule matches as written, without a
+ * trailing carriage return (DOS line endings).  If the rule uses the legacy
+ * attribute names "Email" or "E", which OpenSSL prints as "emailAddress", it
+ * also matches with the names spelled that way.  Names are only rewritten at
+ * the start of an RDN, not inside attribute values.  The subject is never
+ * rewritten, so that attribute values cannot be turned into attribute names.
+ */
+void AddDnRule(const std::string &rule, std::vector<std::string> *dns);
+
+/**
+ * An immutable set of DNs: an open addressing hash table with
+ * linear probing, sized to a power of two of at least twice the number of
+ * DNs, as the revocation index.  Large sets are fronted by a Bloom filter so
+ * that the common miss does not touch the table.
+ */
+class DnSet {
+ public:
+  DnSet() : m_bloom_mask(0) { }
+  void Build(const std::vector<std::string> &dns);
+
+  bool Contains(const std::string &dn) const;
+  bool empty() const {return m_dns.empty();}
+
+ private:
+  /**
+   * Sets with fewer DNs fit into a few cache lines anyway.
+   */
+  static const unsigned kBloomThreshold = 256;
+  static const uint32_t kEmptySlot = 0xFFFFFFFF;
+
+  struct Slot {
+    uint64_t hash;
+    uint32_t index;  ///< into m_dns
+  };
+
+  static uint64_t Hash(const std::string &dn);
+  bool MaybeContains(uint64_t hash) const;
+
+  std::vector<std::string> m_dns;
+  std::vector<Slot> m_slots;
+  std::vector<uint64_t> m_bloom;
+  uint64_t m_bloom_mask;
+};
+
+#endif  // CVMFS_AUTHZ_X509_HELPER_DN_H_
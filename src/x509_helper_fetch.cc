@@ -7,23 +7,137 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cassert>
 #include <climits>
 #include <cstdio>
 #include <cstring>
 #include <sstream>
 
+#include "x509_helper_cache.h"
+#include "x509_helper_digest.h"
 #include "x509_helper_log.h"
 #include "helper_utils.h"
 
 using namespace std;  // NOLINT
 
+namespace {
+CredentialFileCache proxy_files(64);
+}
+
+
+void GetProcessInfo(const AuthzRequest &authz_req, const vector<string> &names,
+                    ProcessInfo *info)
+{
+  ProcessSnapshot snapshot;
+  ReadProcessSnapshot(authz_req.pid, &snapshot);
+  const uint64_t environ_hash = HashEnviron(snapshot.environ_content);
+
+  string key;
+  if (snapshot.has_start_time) {
+    stringstream key_stream;
+    key_stream << authz_req.pid << ":" << snapshot.start_time;
+    key = key_stream.str();
+    const ProcessInfo *cached = ProcessCache::GetInstance()->Lookup(key);
+    if ((cached != NULL) && (cached->uid == authz_req.uid) &&
+        (cached->gid == authz_req.gid) &&
+        (cached->environ_hash == environ_hash))
+    {
+      LogAuthz(kLogAuthzDebug, "process %s known", key.c_str());
+      *info = *cached;
+      return;
+    }
+  }
+
+  *info = ProcessInfo();
+  info->key = key;
+  info->uid = authz_req.uid;
+  info->gid = authz_req.gid;
+  info->environ_hash = environ_hash;
+  info->expiry = time(NULL) + ProcessCache::kMaxLifetime;
+  ParseProcessEnvironment(snapshot.environ_content, names, &info->env);
+  if (snapshot.has_container)
+    info->container = snapshot.container;
+  else if (!GetContainerIdentity(authz_req.pid, &info->container))
+    info->container.clear();
+  if (!key.empty())
+    ProcessCache::GetInstance()->Insert(*info);
+}
+
+
+bool IsOpenedFile(const ProcessInfo &info, const string &path,
+                  const FileIdentity &identity)
+{
+  if (info.key.empty())
+    return false;
+  map<string, FileIdentity>::const_iterator it = info.opened.find(path);
+  return (it != info.opened.end()) && (it->second == identity);
+}
+
+
+void RememberOpenedFile(const string &path, const FileIdentity &identity,
+                        ProcessInfo *info)
+{
+  if (info->key.empty())
+    return;
+  info->opened[path] = identity;
+  ProcessCache::GetInstance()->Insert(*info);
+}
+
+
+/**
+ * Reads the whole file with read(2), bypassing stdio buffering.  The buffer
+ * is sized by fstat; one extra byte detects files that grew in between.
+ */
+static bool ReadProxy(FILE *fproxy, string *proxy) {
+  const int fd = fileno(fproxy);
+  struct stat info;
+  size_t capacity = 4096;
+  if ((fstat(fd, &info) == 0) && (info.st_size > 0))
+    capacity = static_cast<size_t>(info.st_size) + 1;
+  if (capacity > kMaxProxySize + 1)
+    capacity = kMaxProxySize + 1;
+
+  proxy->resize(capacity);
+  size_t size = 0;
+  while (true) {
+    if (size == proxy->size()) {
+      if (size > kMaxProxySize)
+        break;
+      proxy->resize(min(2 * size, kMaxProxySize + 1));
+    }
+    const ssize_t nbytes = read(fd, &(*proxy)[size], proxy->size() - size);
+    if (nbytes < 0) {
+      if (errno == EINTR)
+        continue;
+      LogAuthz(kLogAuthzDebug, "failed to read proxy (%d)", errno);
+      return false;
+    }
+    if (nbytes == 0)
+      break;
+    size += nbytes;
+  }
+  if (size > kMaxProxySize) {
+    LogAuthz(kLogAuthzDebug, "proxy exceeds %u bytes",
+             static_cast<unsigned>(kMaxProxySize));
+    return false;
+  }
+  proxy->resize(size);
+  return true;
+}
 
-FILE *GetX509Proxy(
-const AuthzRequest &authz_req, string *proxy) {
+
+ProxyStatus GetX509Proxy(const AuthzRequest &authz_req, ProcessInfo *info,
+                         string *proxy, string *fingerprint,
+                         ProxySource *source)
+{
+  assert(info != NULL);
   assert(proxy != NULL);
+  assert(fingerprint != NULL);
+  assert(source != NULL);
 
   stringstream default_path;
   default_path << "/tmp/x509up_u" << authz_req.uid;
@@ -32,24 +146,84 @@ const AuthzRequest &authz_req, string *proxy) {
     default_path_str = "";
   }
 
+  string path;
+  if (!GetFilePath(info->env, "X509_USER_PROXY", default_path_str, &path))
+    return kProxyNotFound;
+
+  NegativeCache *negative_cache = NegativeCache::GetInstance();
+  if (!info->container.empty()) {
+    stringstream key;
+    key << "x509:" << info->container << ":" << authz_req.uid << ":" << path;
+    source->key = key.str();
+    if (negative_cache->IsNotFound(source->key)) {
+      LogAuthz(kLogAuthzDebug, "proxy recently not found for %s",
+               authz_req.Ident().c_str());
+      return kProxyNotFound;
+    }
+    FileIdentity identity;
+    if (GetFileIdentityAt(authz_req.pid, path, &identity)) {
+      if (negative_cache->IsInvalid(source->key, identity, fingerprint)) {
+        LogAuthz(kLogAuthzDebug, "proxy recently rejected for %s",
+                 authz_req.Ident().c_str());
+        return kProxyKnownInvalid;
+      }
+      const CachedCredential *cached = NULL;
+      if (IsOpenedFile(*info, path, identity))
+        cached = proxy_files.Lookup(identity);
+      if (cached != NULL) {
+        LogAuthz(kLogAuthzDebug, "proxy of %s unchanged, skip opening it",
+                 authz_req.Ident().c_str());
+        source->has_identity = true;
+        source->identity = identity;
+        *proxy = cached->content;
+        *fingerprint = cached->fingerprint;
+        return kProxyFound;
+      }
+    }
+  }
+
   FILE *fproxy =
-    GetFile("X509_USER_PROXY", authz_req.pid, authz_req.uid, authz_req.gid, default_path_str);
+    OpenFileAs(path, authz_req.pid, authz_req.uid, authz_req.gid);
   if (fproxy == NULL) {
     LogAuthz(kLogAuthzDebug, "no proxy found for %s",
              authz_req.Ident().c_str());
-    return NULL;
+    if (!source->key.empty())
+      negative_cache->InsertNotFound(source->key);
+    return kProxyNotFound;
+  }
+
+  source->has_identity = GetFileIdentity(fproxy, &source->identity);
+  if (source->has_identity) {
+    RememberOpenedFile(path, source->identity, info);
+    const CachedCredential *cached = proxy_files.Lookup(source->identity);
+    if (cached != NULL) {
+      LogAuthz(kLogAuthzDebug, "proxy file unchanged, skip reading it");
+      fclose(fproxy);
+      *proxy = cached->content;
+      *fingerprint = cached->fingerprint;
+      return kProxyFound;
+    }
   }
 
-  proxy->clear();
-  const unsigned kBufSize = 1024;
-  char buf[kBufSize];
-  unsigned nbytes;
-  do {
-    nbytes = fread(buf, 1, kBufSize, fproxy);
-    if (nbytes > 0)
-      proxy->append(string(buf, nbytes));
-  } while (nbytes == kBufSize);
+  const bool retval = ReadProxy(fproxy, proxy);
+  fclose(fproxy);
+  if (!retval)
+    return kProxyNotFound;
+  *fingerprint = Sha256(*proxy);
+  if (source->has_identity) {
+    CachedCredential credential;
+    credential.content = *proxy;
+    credential.fingerprint = *fingerprint;
+    proxy_files.Insert(source->identity, credential);
+  }
+  return kProxyFound;
+}
+
 
-  rewind(fproxy);
-  return fproxy;
+void RememberInvalidProxy(const ProxySource &source, const string &fingerprint)
+{
+  if (source.key.empty() || !source.has_identity)
+    return;
+  NegativeCache::GetInstance()->InsertInvalid(source.key, source.identity,
+                                              fingerprint);
 }
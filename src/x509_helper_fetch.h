@@ -7,11 +7,74 @@
 
 #include <unistd.h>
 
-#include <cstdio>
+#include <cstddef>
 #include <string>
+#include <vector>
 
+#include "helper_utils.h"
 #include "x509_helper_req.h"
 
-FILE *GetX509Proxy(const AuthzRequest &authz_req, std::string *proxy);
+/**
+ * Reads the environment variables in names and the container identity of the
+ * requesting process.  Both are reused from the ProcessCache as long as the
+ * process, i.e. pid and start time, its uid and gid, and its environment are
+ * unchanged.
+ */
+void GetProcessInfo(const AuthzRequest &authz_req,
+                    const std::vector<std::string> &names, ProcessInfo *info);
+
+/**
+ * True if path was opened before on behalf of the same process and the file
+ * it resolves to, stat'ed through /proc/<pid>/root, is still identity.  Then
+ * opening it again with the user's credentials can be skipped.
+ */
+bool IsOpenedFile(const ProcessInfo &info, const std::string &path,
+                  const FileIdentity &identity);
+
+void RememberOpenedFile(const std::string &path, const FileIdentity &identity,
+                        ProcessInfo *info);
+
+enum ProxyStatus {
+  kProxyFound,
+  kProxyNotFound,
+  kProxyKnownInvalid,  ///< The unchanged proxy file was rejected recently
+};
+
+/**
+ * Where a proxy was taken from; used to remember rejected proxies.
+ */
+struct ProxySource {
+  ProxySource() : has_identity(false) {}
+  /**
+   * Container identity, uid and resolved path; empty if the container of the
+   * requesting process could not be identified.
+   */
+  std::string key;
+  bool has_identity;
+  FileIdentity identity;
+};
+
+/**
+ * Reads the proxy of the requesting process into proxy, with a single read
+ * sized by the file size.  The fingerprint is set to the SHA-256 of the proxy
+ * content.  There is no proxy if it cannot be opened or if it is larger than
+ * kMaxProxySize.  Proxies that were recently not found, or rejected by
+ * RememberInvalidProxy() and are unchanged since, are reported without
+ * opening the file again.  For known invalid proxies, only the fingerprint is
+ * set.  Proxies that were read before for the same process and are unchanged
+ * are taken from memory without switching into its namespace.  info.env needs
+ * X509_USER_PROXY.
+ */
+ProxyStatus GetX509Proxy(const AuthzRequest &authz_req, ProcessInfo *info,
+                         std::string *proxy, std::string *fingerprint,
+                         ProxySource *source);
+
+void RememberInvalidProxy(const ProxySource &source,
+                          const std::string &fingerprint);
+
+/**
+ * Proxies with a few VOMS attribute certificates are around 10 kB.
+ */
+const size_t kMaxProxySize = 256 * 1024;
 
 #endif  // CVMFS_AUTHZ_X509_HELPER_FETCH_H_
@@ -0,0 +1,79 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+#include "x509_helper_fqan.h"
+
+#include "x509_helper_voms.h"
+
+using namespace std;  // NOLINT
+
+
+void SplitGroupToPaths(const string &group, vector<string> *hierarchy) {
+  size_t start = 0, end = 0;
+  while ((end = group.find('/', start)) != std::string::npos) {
+    if (end-start) {
+      hierarchy->push_back(group.substr(start, end-start));
+    }
+    start = end + 1;
+  }
+  if (start != group.size()-1) {hierarchy->push_back(group.substr(start));}
+}
+
+
+unsigned FqanIndex::NewNode() {
+  m_nodes.push_back(Node());
+  return m_nodes.size() - 1;
+}
+
+
+void FqanIndex::Build(const vector<VomsAttributes> &attributes) {
+  m_roots.clear();
+  m_nodes.clear();
+  for (unsigned idx = 0; idx < attributes.size(); ++idx) {
+    const VomsAttributes &vo = attributes[idx];
+    // A VO without FQANs authorizes nothing, so it gets no node
+    for (unsigned idx2 = 0; idx2 < vo.fqans.size(); ++idx2) {
+      const VomsFqan &fqan = vo.fqans[idx2];
+      const bool has_role = (fqan.role != "NULL");
+      vector<string> hierarchy;
+      SplitGroupToPaths(fqan.group, &hierarchy);
+
+      map<string, unsigned>::const_iterator root = m_roots.find(vo.voname);
+      unsigned node = (root == m_roots.end()) ?
+                      (m_roots[vo.voname] = NewNode()) : root->second;
+      if (has_role)
+        m_nodes[node].roles.insert(fqan.role);
+      for (unsigned i = 0; i < hierarchy.size(); ++i) {
+        map<string, unsigned>::const_iterator child =
+          m_nodes[node].children.find(hierarchy[i]);
+        if (child == m_nodes[node].children.end()) {
+          const unsigned new_node = NewNode();
+          m_nodes[node].children[hierarchy[i]] = new_node;
+          node = new_node;
+        } else {
+          node = child->second;
+        }
+        if (has_role)
+          m_nodes[node].roles.insert(fqan.role);
+      }
+    }
+  }
+}
+
+
+bool FqanIndex::Matches(const string &vo, const vector<string> &group,
+                        bool any_role, const string &role) const
+{
+  map<string, unsigned>::const_iterator root = m_roots.find(vo);
+  if (root == m_roots.end())
+    return false;
+  unsigned node = root->second;
+  for (unsigned i = 0; i < group.size(); ++i) {
+    map<string, unsigned>::const_iterator child =
+      m_nodes[node].children.find(group[i]);
+    if (child == m_nodes[node].children.end())
+      return false;
+    node = child->second;
+  }
+  return any_role || (m_nodes[node].roles.count(role) > 0);
+}
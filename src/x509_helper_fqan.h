@@ -0,0 +1,53 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_AUTHZ_X509_HELPER_FQAN_H_
+#define CVMFS_AUTHZ_X509_HELPER_FQAN_H_
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+struct VomsAttributes;
+
+/**
+ * Splits a VOMS group such as /atlas/production into its components.
+ */
+void SplitGroupToPaths(const std::string &group,
+                       std::vector<std::string> *hierarchy);
+
+/**
+ * The FQANs of a credential, indexed by VO into a trie of group components.
+ * Every node knows the roles held in its group or any of its sub-groups, so
+ * that checking a membership rule is a walk down the rule's hierarchy
+ * without allocations.  Built once per set of verified attribute
+ * certificates.
+ */
+class FqanIndex {
+ public:
+  void Build(const std::vector<VomsAttributes> &attributes);
+
+  /**
+   * True if the credential has an FQAN in group (given as its components) or
+   * in one of its sub-groups, with the given role unless any_role is set.
+   */
+  bool Matches(const std::string &vo, const std::vector<std::string> &group,
+               bool any_role, const std::string &role) const;
+
+  bool empty() const {return m_roots.empty();}
+
+ private:
+  struct Node {
+    std::map<std::string, unsigned> children;
+    std::set<std::string> roles;
+  };
+
+  unsigned NewNode();
+
+  std::map<std::string, unsigned> m_roots;
+  std::vector<Node> m_nodes;
+};
+
+#endif  // CVMFS_AUTHZ_X509_HELPER_FQAN_H_
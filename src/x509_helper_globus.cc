@@ -7,6 +7,7 @@
 #include <errno.h>
 #include <limits.h>
 #include <pthread.h>
+#include <stdlib.h>
 #include <time.h>
 
 #include <map>
@@ -76,6 +77,9 @@ globus_result_t (*g_globus_gsi_callback_data_destroy)(
 globus_result_t (*g_globus_gsi_callback_set_cert_dir)(
     globus_gsi_callback_data_t          callback_data,
     char *                              cert_dir) = NULL;
+globus_result_t (*g_globus_gsi_callback_get_cert_chain)(
+    globus_gsi_callback_data_t          callback_data,
+    STACK_OF(X509) **                   cert_chain) = NULL;
 globus_result_t (*g_globus_gsi_sysconfig_get_cert_dir_unix)(
     char **                             cert_dir) = NULL;
 }
@@ -83,6 +87,7 @@ globus_result_t (*g_globus_gsi_sysconfig_get_cert_dir_unix)(
 
 GlobusLib::GlobusLib() :
   m_zombie(true),
+  m_cert_dir(NULL),
   m_globus_module_handle(NULL),
   m_globus_gsi_cert_utils_handle(NULL),
   m_globus_gsi_credential_handle(NULL),
@@ -117,8 +122,138 @@ GlobusLib::PrintError(globus_result_t result) {
 }
 
 
+globus_gsi_cred_handle_t GlobusLib::NewCredHandle() {
+  globus_gsi_cred_handle_t handle = NULL;
+  globus_result_t result = (*g_globus_gsi_cred_handle_init)(&handle, NULL);
+  if (GLOBUS_SUCCESS != result) {
+    PrintError(result);
+    return NULL;
+  }
+  return handle;
+}
+
+
+globus_gsi_callback_data_t GlobusLib::NewCallback() {
+  const char *cert_dir = GetCertDir();
+  if (!cert_dir)
+    return NULL;
+  globus_gsi_callback_data_t callback = NULL;
+  globus_result_t result = (*g_globus_gsi_callback_data_init)(&callback);
+  if (GLOBUS_SUCCESS != result) {
+    PrintError(result);
+    return NULL;
+  }
+  result = (*g_globus_gsi_callback_set_cert_dir)(callback,
+                                                 const_cast<char *>(cert_dir));
+  if (GLOBUS_SUCCESS != result) {
+    PrintError(result);
+    (*g_globus_gsi_callback_data_destroy)(callback);
+    return NULL;
+  }
+  return callback;
+}
+
+
+globus_gsi_cred_handle_t GlobusLib::AcquireCredHandle() {
+  if (m_cred_pool.empty())
+    return NewCredHandle();
+  globus_gsi_cred_handle_t handle = m_cred_pool.back();
+  m_cred_pool.pop_back();
+  return handle;
+}
+
+
+globus_gsi_callback_data_t GlobusLib::AcquireCallback() {
+  if (m_callback_pool.empty())
+    return NewCallback();
+  globus_gsi_callback_data_t callback = m_callback_pool.back();
+  m_callback_pool.pop_back();
+  return callback;
+}
+
+
+void GlobusLib::RetireCredHandle(globus_gsi_cred_handle_t handle) {
+  m_retired_creds.push_back(handle);
+}
+
+
+void GlobusLib::RetireCallback(globus_gsi_callback_data_t callback) {
+  m_retired_callbacks.push_back(callback);
+}
+
+
+void GlobusLib::Replenish() {
+  if (m_zombie)
+    return;
+  for (unsigned i = 0; i < m_retired_creds.size(); ++i)
+    (*g_globus_gsi_cred_handle_destroy)(m_retired_creds[i]);
+  m_retired_creds.clear();
+  for (unsigned i = 0; i < m_retired_callbacks.size(); ++i)
+    (*g_globus_gsi_callback_data_destroy)(m_retired_callbacks[i]);
+  m_retired_callbacks.clear();
+
+  while (m_cred_pool.size() < kPoolSize) {
+    globus_gsi_cred_handle_t handle = NewCredHandle();
+    if (!handle)
+      break;
+    m_cred_pool.push_back(handle);
+  }
+  while (m_callback_pool.size() < kPoolSize) {
+    globus_gsi_callback_data_t callback = NewCallback();
+    if (!callback)
+      break;
+    m_callback_pool.push_back(callback);
+  }
+}
+
+
+const char *GlobusLib::GetCertDir() {
+  if (m_cert_dir)
+    return m_cert_dir;
+  globus_result_t result =
+    (*g_globus_gsi_sysconfig_get_cert_dir_unix)(&m_cert_dir);
+  if (GLOBUS_SUCCESS != result) {
+    LogAuthz(kLogAuthzDebug,
+             "Failed to determine trusted certificates directory.");
+    PrintError(result);
+    m_cert_dir = NULL;
+    return NULL;
+  }
+  LogAuthz(kLogAuthzDebug, "Globus uses certificates directory %s",
+           m_cert_dir);
+  return m_cert_dir;
+}
+
+
+/**
+ * Pooled callback objects refer to the old directory and are dropped, too.
+ */
+void GlobusLib::InvalidateCertDir() {
+  free(m_cert_dir);
+  m_cert_dir = NULL;
+  for (unsigned i = 0; i < m_callback_pool.size(); ++i)
+    m_retired_callbacks.push_back(m_callback_pool[i]);
+  m_callback_pool.clear();
+}
+
+
+void GlobusLib::DrainPools() {
+  m_retired_creds.insert(m_retired_creds.end(),
+                         m_cred_pool.begin(), m_cred_pool.end());
+  m_cred_pool.clear();
+  InvalidateCertDir();
+  for (unsigned i = 0; i < m_retired_creds.size(); ++i)
+    (*g_globus_gsi_cred_handle_destroy)(m_retired_creds[i]);
+  m_retired_creds.clear();
+  for (unsigned i = 0; i < m_retired_callbacks.size(); ++i)
+    (*g_globus_gsi_callback_data_destroy)(m_retired_callbacks[i]);
+  m_retired_callbacks.clear();
+}
+
+
 void GlobusLib::Close() {
   if (!m_zombie) {
+    DrainPools();
     (*g_globus_module_deactivate)(g_globus_i_gsi_cert_utils_module);
     (*g_globus_module_deactivate)(g_globus_i_gsi_credential_module);
     (*g_globus_module_deactivate)(g_globus_i_gsi_callback_module);
@@ -149,6 +284,7 @@ void GlobusLib::Close() {
   g_globus_gsi_callback_data_init = NULL;
   g_globus_gsi_callback_data_destroy = NULL;
   g_globus_gsi_callback_set_cert_dir = NULL;
+  g_globus_gsi_callback_get_cert_chain = NULL;
   g_globus_gsi_sysconfig_get_cert_dir_unix = NULL;
   m_zombie = true;
 }
@@ -235,6 +371,9 @@ void GlobusLib::Load() {
       !LoadSymbol(m_globus_gsi_callback_handle,
                   &g_globus_gsi_callback_set_cert_dir,
                   "globus_gsi_callback_set_cert_dir") ||
+      !LoadSymbol(m_globus_gsi_callback_handle,
+                  &g_globus_gsi_callback_get_cert_chain,
+                  "globus_gsi_callback_get_cert_chain") ||
       !LoadSymbol(m_globus_gsi_sysconfig_handle,
                   &g_globus_gsi_sysconfig_get_cert_dir_unix,
                   "globus_gsi_sysconfig_get_cert_dir_unix")
@@ -271,6 +410,7 @@ void GlobusLib::Load() {
   }
   LogAuthz(kLogAuthzDebug, "Successfully loaded Globus library");
   m_zombie = false;
+  Replenish();
 }
 
 GlobusLib *GlobusLib::g_globus = NULL;
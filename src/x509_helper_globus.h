@@ -5,6 +5,8 @@
 #ifndef CVMFS_AUTHZ_X509_HELPER_GLOBUS_H_
 #define CVMFS_AUTHZ_X509_HELPER_GLOBUS_H_
 
+#include <vector>
+
 #include "globus/globus_gsi_cert_utils.h"
 #include "globus/globus_gsi_credential.h"
 #include "globus/globus_module.h"
@@ -67,6 +69,9 @@ extern globus_result_t (*g_globus_gsi_callback_data_destroy)(
 extern globus_result_t (*g_globus_gsi_callback_set_cert_dir)(
     globus_gsi_callback_data_t          callback_data,
     char *                              cert_dir);
+extern globus_result_t (*g_globus_gsi_callback_get_cert_chain)(
+    globus_gsi_callback_data_t          callback_data,
+    STACK_OF(X509) **                   cert_chain);
 extern globus_result_t (*g_globus_gsi_sysconfig_get_cert_dir_unix)(
     char **                             cert_dir);
 }
@@ -86,13 +91,44 @@ class GlobusLib {
 
   bool IsValid() const {return !m_zombie;}
 
+  /**
+   * Credential handles and callback data objects are prepared ahead of time.
+   * Each request takes fresh objects from the pools and retires them when it
+   * is done.  Replenish() destroys the retired objects and refills the pools;
+   * it is called while the helper waits for the next request, so neither
+   * setup nor teardown is on the critical path.  Acquire functions return
+   * NULL on failure.
+   */
+  globus_gsi_cred_handle_t AcquireCredHandle();
+  globus_gsi_callback_data_t AcquireCallback();
+  void RetireCredHandle(globus_gsi_cred_handle_t handle);
+  void RetireCallback(globus_gsi_callback_data_t callback);
+  void Replenish();
+  /**
+   * The trusted certificates directory is looked up once and stays valid
+   * until the directory is replaced.
+   */
+  const char *GetCertDir();
+  void InvalidateCertDir();
+
  private:
+  static const unsigned kPoolSize = 2;
+
   GlobusLib(const GlobusLib&);
   void Close();
   void Load();
+  globus_gsi_cred_handle_t NewCredHandle();
+  globus_gsi_callback_data_t NewCallback();
+  void DrainPools();
 
   bool m_zombie;
 
+  char *m_cert_dir;
+  std::vector<globus_gsi_cred_handle_t> m_cred_pool;
+  std::vector<globus_gsi_callback_data_t> m_callback_pool;
+  std::vector<globus_gsi_cred_handle_t> m_retired_creds;
+  std::vector<globus_gsi_callback_data_t> m_retired_callbacks;
+
   // Various library handles.
   void *m_globus_module_handle;
   void *m_globus_gsi_cert_utils_handle;
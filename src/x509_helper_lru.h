@@ -0,0 +1,88 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_AUTHZ_X509_HELPER_LRU_H_
+#define CVMFS_AUTHZ_X509_HELPER_LRU_H_
+
+#include <time.h>
+
+#include <cassert>
+#include <list>
+#include <map>
+
+/**
+ * A small least-recently-used cache whose entries additionally carry an
+ * absolute expiry time.  Expired entries are treated as misses and dropped
+ * on lookup.  The helper is single-threaded, so there is no locking.
+ *
+ * Pointers returned by Lookup() and Insert() remain valid until the entry is
+ * evicted, i.e. until the next Insert(), Erase() or Clear().
+ */
+template <class Key, class Value>
+class LruCache {
+ public:
+  explicit LruCache(unsigned capacity) : m_capacity(capacity) {
+    assert(m_capacity > 0);
+  }
+
+  const Value *Lookup(const Key &key) {
+    typename Index::iterator it = m_index.find(key);
+    if (it == m_index.end())
+      return NULL;
+    if (it->second->expiry <= time(NULL)) {
+      m_entries.erase(it->second);
+      m_index.erase(it);
+      return NULL;
+    }
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    return &it->second->value;
+  }
+
+  const Value *Insert(const Key &key, const Value &value, time_t expiry) {
+    Erase(key);
+    if (m_entries.size() >= m_capacity) {
+      m_index.erase(m_entries.back().key);
+      m_entries.pop_back();
+    }
+    Entry entry;
+    entry.key = key;
+    entry.value = value;
+    entry.expiry = expiry;
+    m_entries.push_front(entry);
+    m_index[key] = m_entries.begin();
+    return &m_entries.front().value;
+  }
+
+  void Erase(const Key &key) {
+    typename Index::iterator it = m_index.find(key);
+    if (it == m_index.end())
+      return;
+    m_entries.erase(it->second);
+    m_index.erase(it);
+  }
+
+  void Clear() {
+    m_entries.clear();
+    m_index.clear();
+  }
+
+  unsigned size() const {return m_index.size();}
+
+ private:
+  struct Entry {
+    Key key;
+    Value value;
+    time_t expiry;
+  };
+  typedef std::list<Entry> EntryList;
+  typedef std::map<Key, typename EntryList::iterator> Index;
+
+  LruCache(const LruCache&);
+
+  unsigned m_capacity;
+  EntryList m_entries;
+  Index m_index;
+};
+
+#endif  // CVMFS_AUTHZ_X509_HELPER_LRU_H_
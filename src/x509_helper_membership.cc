@@ -0,0 +1,112 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+#include "x509_helper_membership.h"
+
+#include <time.h>
+
+#include "x509_helper_base64.h"
+#include "x509_helper_digest.h"
+#include "x509_helper_fqan.h"
+#include "x509_helper_log.h"
+
+using namespace std;  // NOLINT
+
+
+MembershipRules::MembershipRules(const string &key, const string &membership)
+  : m_key(key)
+  , m_text(membership)
+{
+  vector<string> dns;
+  size_t last_delim = 0;
+  size_t delim = membership.find('\n');
+  while (delim != std::string::npos) {
+    AddRule(membership.substr(last_delim, delim-last_delim), &dns);
+    last_delim = delim + 1;
+    delim = membership.find('\n', last_delim);
+  }
+  AddRule(membership.substr(last_delim), &dns);
+  m_dns.Build(dns);
+}
+
+
+void MembershipRules::AddRule(const string &rule, vector<string> *dns) {
+  // An empty entry should authorize nobody.
+  if (rule.empty()) {return;}
+
+  // No VOMS info in the authz; it is a DN.
+  if (rule[0] == '/') {
+    AddDnRule(rule, dns);
+    return;
+  }
+
+  // Break the authz into VOMS VO, groups, and roles.
+  string vo, role, group;
+  size_t delim = rule.find(':');
+  if (delim != std::string::npos) {
+    vo = rule.substr(0, delim);
+    size_t delim2 = rule.find("/Role=", delim+1);
+    if (delim2 != std::string::npos) {
+      role = rule.substr(delim2 + 6);
+      group = rule.substr(delim + 1, delim2 - delim - 1);
+    } else {
+      group = rule.substr(delim + 1);
+    }
+  }
+  // Quick sanity check of group name.
+  if (!group.empty() && group[0] != '/') {return;}
+
+  GroupRule group_rule;
+  SplitGroupToPaths(group, &group_rule.hierarchy);
+  group_rule.any_role = role.empty() || (role == "NULL");
+  group_rule.role = role;
+  m_vo_rules[vo].push_back(group_rule);
+}
+
+
+/**
+ * Roles must match exactly; sub-groups are authorized in their parent group.
+ */
+bool MembershipRules::Matches(const authz_data &authz) const {
+  if (m_dns.Contains(authz.subject_))
+    return true;
+  if (authz.fqans_.empty())
+    return false;
+
+  for (map<string, vector<GroupRule> >::const_iterator it = m_vo_rules.begin();
+       it != m_vo_rules.end(); ++it)
+  {
+    for (unsigned idx = 0; idx < it->second.size(); ++idx) {
+      const GroupRule &rule = it->second[idx];
+      if (authz.fqans_.Matches(it->first, rule.hierarchy, rule.any_role,
+                               rule.role))
+      {
+        LogAuthz(kLogAuthzDebug, "matches rule %u of VO %s",
+                 idx, it->first.c_str());
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+
+const MembershipRules *MembershipCache::Get(const string &membership_base64) {
+  const string key = Sha256(membership_base64);
+  const MembershipRules *rules = m_rules.Lookup(key);
+  if (rules != NULL)
+    return rules;
+
+  string membership;
+  if (!Debase64(membership_base64, &membership)) {
+    // An empty membership authorizes nobody
+    LogAuthz(kLogAuthzDebug | kLogAuthzSyslog | kLogAuthzSyslogErr,
+             "invalid Base64 encoding of membership");
+  }
+  LogAuthz(kLogAuthzDebug, "compiled membership %s", membership.c_str());
+  return m_rules.Insert(key, MembershipRules(key, membership),
+                        time(NULL) + kMaxLifetime);
+}
+
+MembershipCache *MembershipCache::g_membership_cache = NULL;
@@ -0,0 +1,87 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_AUTHZ_X509_HELPER_MEMBERSHIP_H_
+#define CVMFS_AUTHZ_X509_HELPER_MEMBERSHIP_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "x509_helper_dn.h"
+#include "x509_helper_lru.h"
+#include "x509_helper_voms.h"
+
+/**
+ * The membership list of a repository, compiled once from the Base64 string
+ * sent by the cvmfs client.  Every line is either a DN, which has to match
+ * the subject of the EEC (see AddDnRule()), or a VOMS rule of the
+ * form <vo>:<group>[/Role=<role>].  Sub-groups are authorized in their parent
+ * group; a missing or "NULL" role matches any role.  Empty and malformed
+ * lines authorize nobody.
+ */
+class MembershipRules {
+ public:
+  MembershipRules() { }
+  MembershipRules(const std::string &key, const std::string &membership);
+
+  bool Matches(const authz_data &authz) const;
+
+  /**
+   * Identifies the membership list; the SHA-256 of its Base64 encoding.
+   */
+  const std::string &key() const {return m_key;}
+  /**
+   * The decoded membership list, one rule per line.
+   */
+  const std::string &text() const {return m_text;}
+
+ private:
+  struct GroupRule {
+    std::vector<std::string> hierarchy;
+    bool any_role;
+    std::string role;
+  };
+
+  void AddRule(const std::string &rule, std::vector<std::string> *dns);
+
+  std::string m_key;
+  std::string m_text;
+  DnSet m_dns;
+  std::map<std::string, std::vector<GroupRule> > m_vo_rules;
+};
+
+
+/**
+ * Keeps the compiled rules of the last few membership lists; the membership
+ * only changes with the repository policy.
+ */
+class MembershipCache {
+ public:
+  static MembershipCache *GetInstance() {
+    if (!g_membership_cache)
+      g_membership_cache = new MembershipCache();
+    return g_membership_cache;
+  }
+
+  /**
+   * Returns the compiled rules for the Base64 encoded membership.  Invalid
+   * Base64 results in rules that authorize nobody.  The pointer is valid
+   * until the next call.
+   */
+  const MembershipRules *Get(const std::string &membership_base64);
+
+ private:
+  static const time_t kMaxLifetime = 3600;
+  static const unsigned kCapacity = 8;
+
+  MembershipCache() : m_rules(kCapacity) {}
+  MembershipCache(const MembershipCache&);
+
+  LruCache<std::string, MembershipRules> m_rules;
+
+  static MembershipCache *g_membership_cache;
+};
+
+#endif  // CVMFS_AUTHZ_X509_HELPER_MEMBERSHIP_H_
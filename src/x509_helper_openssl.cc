@@ -0,0 +1,199 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+#include "x509_helper_openssl.h"
+
+#include <fnmatch.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/x509v3.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "x509_helper_chain.h"
+#include "x509_helper_log.h"
+#include "x509_helper_truststore.h"
+
+using namespace std;  // NOLINT
+
+
+static bool IsProxy(X509 *cert) {
+  return (X509_get_extension_flags(cert) & EXFLAG_PROXY) != 0;
+}
+
+
+bool ReadProxyPem(BIO *bio, X509 **cert, EVP_PKEY **key,
+                  STACK_OF(X509) **chain)
+{
+  *chain = sk_X509_new_null();
+  if (!*chain)
+    return false;
+  char *name = NULL;
+  char *header = NULL;
+  unsigned char *data = NULL;
+  long length;
+  bool retval = true;
+  while (retval && PEM_read_bio(bio, &name, &header, &data, &length)) {
+    const unsigned char *der = data;
+    if (strcmp(name, PEM_STRING_X509) == 0) {
+      X509 *x509 = d2i_X509(NULL, &der, length);
+      if (!x509) {
+        retval = false;
+      } else if (!*cert) {
+        *cert = x509;
+      } else {
+        sk_X509_push(*chain, x509);
+      }
+    } else if (strstr(name, "PRIVATE KEY") && !*key) {
+      // PKCS#1 and unencrypted PKCS#8 keys
+      *key = d2i_AutoPrivateKey(NULL, &der, length);
+      retval = (*key != NULL);
+    }
+    OPENSSL_free(name);
+    OPENSSL_free(header);
+    OPENSSL_free(data);
+  }
+  ERR_clear_error();
+  if (!retval || !*cert || !*key) {
+    LogAuthz(kLogAuthzDebug, "proxy file is incomplete or damaged");
+    return false;
+  }
+  return true;
+}
+
+
+X509 *GetIdentityCert(X509 *cert, STACK_OF(X509) *chain) {
+  if (!IsProxy(cert))
+    return cert;
+  for (int i = 0; i < sk_X509_num(chain); ++i) {
+    if (!IsProxy(sk_X509_value(chain, i)))
+      return sk_X509_value(chain, i);
+  }
+  return NULL;
+}
+
+
+/**
+ * Minimal reading of the EACL signing policy format:
+ *   access_id_CA   X509    '<CA DN>'
+ *   pos_rights     globus  CA:sign
+ *   cond_subjects  globus  '"<pattern>" "<pattern>" ...'
+ * Patterns use '*' as wildcard.
+ */
+static bool IsAllowedBySigningPolicy(const string &policy, const string &ca,
+                                     const string &subject)
+{
+  string access_id;
+  size_t start = 0;
+  while (start < policy.length()) {
+    size_t end = policy.find('\n', start);
+    if (end == string::npos)
+      end = policy.length();
+    const string line = policy.substr(start, end - start);
+    start = end + 1;
+
+    const size_t key_start = line.find_first_not_of(" \t");
+    if ((key_start == string::npos) || (line[key_start] == '#'))
+      continue;
+    const size_t quote_start = line.find('\'');
+    const size_t quote_end = line.rfind('\'');
+    if ((quote_start == string::npos) || (quote_end <= quote_start))
+      continue;
+    const string value =
+      line.substr(quote_start + 1, quote_end - quote_start - 1);
+
+    if (line.compare(key_start, 12, "access_id_CA") == 0) {
+      access_id = value;
+    } else if ((line.compare(key_start, 13, "cond_subjects") == 0) &&
+               (access_id == ca))
+    {
+      size_t pos = 0;
+      while ((pos = value.find('"', pos)) != string::npos) {
+        const size_t pattern_end = value.find('"', pos + 1);
+        if (pattern_end == string::npos)
+          break;
+        const string pattern = value.substr(pos + 1, pattern_end - pos - 1);
+        if (fnmatch(pattern.c_str(), subject.c_str(), 0) == 0)
+          return true;
+        pos = pattern_end + 1;
+      }
+    }
+  }
+  return false;
+}
+
+
+static string GetDn(X509_NAME *name) {
+  char *dn = X509_NAME_oneline(name, NULL, 0);
+  if (!dn)
+    return "";
+  string result(dn);
+  OPENSSL_free(dn);
+  return result;
+}
+
+
+/**
+ * Every certificate issued by a CA, apart from proxies, must be in the CA's
+ * namespace as given by its signing policy.  Like Globus, a CA without
+ * signing policy is not accepted.
+ */
+static bool CheckSigningPolicies(STACK_OF(X509) *path) {
+  TrustStore *trust_store = TrustStore::GetInstance();
+  for (int i = 0; i + 1 < sk_X509_num(path); ++i) {
+    X509 *cert = sk_X509_value(path, i);
+    if (IsProxy(cert))
+      continue;
+    X509 *ca = sk_X509_value(path, i + 1);
+    const string ca_dn = GetDn(X509_get_subject_name(ca));
+    const string subject = GetDn(X509_get_subject_name(cert));
+    string policy;
+    if (!trust_store->GetSigningPolicy(ca, &policy)) {
+      LogAuthz(kLogAuthzDebug, "no signing policy for %s", ca_dn.c_str());
+      return false;
+    }
+    if (!IsAllowedBySigningPolicy(policy, ca_dn, subject)) {
+      LogAuthz(kLogAuthzDebug, "%s is not in the namespace of %s",
+               subject.c_str(), ca_dn.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+
+static int VerifyCallback(int ok, X509_STORE_CTX *ctx) {
+  if (!ok && (X509_STORE_CTX_get_error(ctx) == X509_V_ERR_UNABLE_TO_GET_CRL))
+    return 1;
+  return ok;
+}
+
+
+bool VerifyProxyChain(X509 *cert, STACK_OF(X509) *chain) {
+  X509_STORE *store = TrustStore::GetInstance()->GetStore();
+  X509_STORE_CTX *ctx = X509_STORE_CTX_new();
+  if (!store || !ctx || !X509_STORE_CTX_init(ctx, store, cert, chain)) {
+    X509_STORE_CTX_free(ctx);
+    return false;
+  }
+  X509_STORE_CTX_set_flags(ctx, X509_V_FLAG_ALLOW_PROXY_CERTS |
+                                X509_V_FLAG_CRL_CHECK |
+                                X509_V_FLAG_CRL_CHECK_ALL);
+  X509_STORE_CTX_set_verify_cb(ctx, VerifyCallback);
+
+  bool retval = (X509_verify_cert(ctx) == 1);
+  if (!retval) {
+    LogAuthz(kLogAuthzDebug, "Failed to validate credentials: %s",
+             X509_verify_cert_error_string(X509_STORE_CTX_get_error(ctx)));
+  } else {
+    STACK_OF(X509) *verified_path = X509_STORE_CTX_get0_chain(ctx);
+    retval = CheckSigningPolicies(verified_path);
+    if (retval)
+      VerifiedChainCache::GetInstance()->Remember(verified_path);
+  }
+  X509_STORE_CTX_free(ctx);
+  ERR_clear_error();
+  return retval;
+}
@@ -0,0 +1,38 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_AUTHZ_X509_HELPER_OPENSSL_H_
+#define CVMFS_AUTHZ_X509_HELPER_OPENSSL_H_
+
+#include <openssl/bio.h>
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+
+/**
+ * Proxy verification with OpenSSL alone, as an alternative to Globus.
+ * Selected with CVMFS_X509_BACKEND=openssl.
+ */
+
+/**
+ * Reads a proxy file in the usual layout: the proxy certificate, its private
+ * key, and the rest of the chain.  The outputs are owned by the caller and
+ * may be set even if the function fails.
+ */
+bool ReadProxyPem(BIO *bio, X509 **cert, EVP_PKEY **key,
+                  STACK_OF(X509) **chain);
+
+/**
+ * Verifies an RFC 3820 proxy chain against the trust store, including CRLs
+ * (a missing CRL is not an error, as in Globus) and the CAs' signing
+ * policies.  On success, the verified path is recorded in the chain cache.
+ */
+bool VerifyProxyChain(X509 *cert, STACK_OF(X509) *chain);
+
+/**
+ * The end entity certificate, i.e. the first certificate that is not a
+ * proxy.  NULL if there is none.
+ */
+X509 *GetIdentityCert(X509 *cert, STACK_OF(X509) *chain);
+
+#endif  // CVMFS_AUTHZ_X509_HELPER_OPENSSL_H_
@@ -16,6 +16,7 @@ struct AuthzRequest {
   uid_t uid;
   gid_t gid;
   pid_t pid;
+  // Base64 encoded, see MembershipCache
   std::string membership;
 
   std::string Ident() const;
@@ -0,0 +1,96 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+#include "x509_helper_revocation.h"
+
+#include <cstring>
+#include <string>
+
+#include "x509_helper_digest.h"
+
+using namespace std;  // NOLINT
+
+
+RevokedKey MakeRevokedKey(X509_NAME *issuer, const ASN1_INTEGER *serial) {
+  string material;
+  const unsigned char *name_der = NULL;
+  size_t name_len = 0;
+  if (X509_NAME_get0_der(issuer, &name_der, &name_len) == 1)
+    material.assign(reinterpret_cast<const char *>(name_der), name_len);
+  unsigned char *serial_der = NULL;
+  int serial_len = i2d_ASN1_INTEGER(const_cast<ASN1_INTEGER *>(serial),
+                                    &serial_der);
+  if (serial_len > 0) {
+    material.append(reinterpret_cast<char *>(serial_der), serial_len);
+    OPENSSL_free(serial_der);
+  }
+
+  const string digest = Sha256(material);
+  RevokedKey key;
+  memcpy(key.digest, digest.data(), sizeof(key.digest));
+  key.digest[0] |= 0x01;
+  return key;
+}
+
+
+void AddRevokedKeys(X509_CRL *crl, vector<RevokedKey> *keys) {
+  X509_NAME *issuer = X509_CRL_get_issuer(crl);
+  STACK_OF(X509_REVOKED) *revoked = X509_CRL_get_REVOKED(crl);
+  for (int i = 0; i < sk_X509_REVOKED_num(revoked); ++i) {
+    const ASN1_INTEGER *serial =
+      X509_REVOKED_get0_serialNumber(sk_X509_REVOKED_value(revoked, i));
+    keys->push_back(MakeRevokedKey(issuer, serial));
+  }
+}
+
+
+static uint32_t SlotOf(const RevokedKey &key, uint32_t nslots) {
+  uint32_t hash;
+  memcpy(&hash, key.digest, sizeof(hash));
+  return hash & (nslots - 1);
+}
+
+
+static bool IsEmptySlot(const RevokedKey &slot) {
+  return (slot.digest[0] & 0x01) == 0;
+}
+
+
+void BuildRevocationTable(const vector<RevokedKey> &keys,
+                          vector<RevokedKey> *table)
+{
+  uint32_t nslots = 1;
+  while (nslots <= 2 * keys.size())
+    nslots *= 2;
+  RevokedKey empty;
+  memset(&empty, 0, sizeof(empty));
+  table->assign(nslots, empty);
+  for (unsigned i = 0; i < keys.size(); ++i) {
+    uint32_t slot = SlotOf(keys[i], nslots);
+    while (!IsEmptySlot((*table)[slot])) {
+      if (memcmp((*table)[slot].digest, keys[i].digest,
+                 sizeof(keys[i].digest)) == 0)
+      {
+        break;
+      }
+      slot = (slot + 1) & (nslots - 1);
+    }
+    (*table)[slot] = keys[i];
+  }
+}
+
+
+/**
+ * Terminates because the table always has at least one empty slot.
+ */
+bool FindRevokedKey(const RevokedKey *table, uint32_t nslots,
+                    const RevokedKey &key)
+{
+  uint32_t slot = SlotOf(key, nslots);
+  while (!IsEmptySlot(table[slot])) {
+    if (memcmp(table[slot].digest, key.digest, sizeof(key.digest)) == 0)
+      return true;
+    slot = (slot + 1) & (nslots - 1);
+  }
+  return false;
+}
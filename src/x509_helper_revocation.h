@@ -0,0 +1,40 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_AUTHZ_X509_HELPER_REVOCATION_H_
+#define CVMFS_AUTHZ_X509_HELPER_REVOCATION_H_
+
+#include <openssl/x509.h>
+#include <stdint.h>
+
+#include <vector>
+
+/**
+ * A revoked certificate is identified by the SHA-256 of its issuer name and
+ * serial number (both DER encoded), truncated to 128 bits.  The key thereby
+ * partitions the index by issuer without the need for per-issuer tables.
+ * The all-zero key marks an empty slot; real keys have the lowest bit set.
+ */
+struct RevokedKey {
+  unsigned char digest[16];
+};
+
+RevokedKey MakeRevokedKey(X509_NAME *issuer, const ASN1_INTEGER *serial);
+/**
+ * Appends the keys of all certificates listed in the CRL.
+ */
+void AddRevokedKeys(X509_CRL *crl, std::vector<RevokedKey> *keys);
+
+/**
+ * The revocation index is an open addressing hash table with linear probing
+ * whose number of slots is a power of two and at least twice the number of
+ * keys.  It is built in memory from the CRLs of the certificates directory or
+ * mapped from a trust bundle, where it is stored verbatim.
+ */
+void BuildRevocationTable(const std::vector<RevokedKey> &keys,
+                          std::vector<RevokedKey> *table);
+bool FindRevokedKey(const RevokedKey *table, uint32_t nslots,
+                    const RevokedKey &key);
+
+#endif  // CVMFS_AUTHZ_X509_HELPER_REVOCATION_H_
@@ -0,0 +1,474 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+#include "x509_helper_truststore.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "x509_helper_log.h"
+
+using namespace std;  // NOLINT
+
+
+TrustStore::TrustStore()
+  : m_bundle(NULL)
+  , m_store(NULL)
+  , m_lookup_method(NULL)
+  , m_inotify_fd(-1)
+{
+  const char *cert_dir = getenv("X509_CERT_DIR");
+  m_cert_dir = cert_dir ? cert_dir : "/etc/grid-security/certificates";
+  m_dir_mtime.tv_sec = m_dir_mtime.tv_nsec = 0;
+
+  const char *bundle_path = getenv("CVMFS_X509_TRUST_BUNDLE");
+  if (bundle_path && (strlen(bundle_path) > 0)) {
+    m_bundle_path = bundle_path;
+    MapBundle();
+    if (m_bundle) {
+      LogAuthz(kLogAuthzDebug, "mapped trust bundle %s with %u entries",
+               m_bundle_path.c_str(), m_bundle->nentries());
+      return;
+    }
+    LogAuthz(kLogAuthzDebug | kLogAuthzSyslogWarn,
+             "cannot use trust bundle %s, reading %s instead",
+             m_bundle_path.c_str(), m_cert_dir.c_str());
+    m_bundle_path.clear();
+  }
+
+  m_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (m_inotify_fd < 0) {
+    LogAuthz(kLogAuthzDebug | kLogAuthzSyslogWarn,
+             "inotify not available (%d), falling back to polling %s",
+             errno, m_cert_dir.c_str());
+  }
+  Watch();
+  LoadAll();
+  IndexRevocations();
+  LogAuthz(kLogAuthzDebug, "loaded %u files from trust store %s",
+           static_cast<unsigned>(m_files.size()), m_cert_dir.c_str());
+}
+
+
+TrustStore::~TrustStore() {
+  for (map<string, File>::iterator it = m_files.begin();
+       it != m_files.end(); ++it)
+  {
+    FreeFile(&it->second);
+  }
+  if (m_inotify_fd >= 0)
+    close(m_inotify_fd);
+  FreeStore();
+  if (m_lookup_method)
+    X509_LOOKUP_meth_free(m_lookup_method);
+  UnmapBundle();
+}
+
+
+void TrustStore::UnmapBundle() {
+  delete m_bundle;
+  m_bundle = NULL;
+}
+
+
+/**
+ * (Re-)maps the bundle if it was replaced since it was last mapped.  Bundles
+ * are replaced by renaming, so a new inode means a new bundle.  A broken
+ * replacement keeps the previous mapping alive.
+ */
+unsigned TrustStore::MapBundle() {
+  struct stat info;
+  if (stat(m_bundle_path.c_str(), &info) != 0)
+    return kTrustStoreUnchanged;
+  if (m_bundle && (m_bundle->dev() == info.st_dev) &&
+      (m_bundle->ino() == info.st_ino))
+  {
+    return kTrustStoreUnchanged;
+  }
+  TrustBundle *bundle = TrustBundle::Open(m_bundle_path);
+  if (bundle == NULL)
+    return kTrustStoreUnchanged;
+  UnmapBundle();
+  m_bundle = bundle;
+  return kTrustStoreCasChanged | kTrustStoreCrlsChanged;
+}
+
+
+void TrustStore::FreeFile(File *file) {
+  for (unsigned i = 0; i < file->certs.size(); ++i)
+    X509_free(file->certs[i]);
+  for (unsigned i = 0; i < file->crls.size(); ++i)
+    X509_CRL_free(file->crls[i]);
+  file->certs.clear();
+  file->crls.clear();
+}
+
+
+unsigned TrustStore::ChangeOf(TrustFileKind kind) {
+  switch (kind) {
+    case kTrustFileCrl:
+      return kTrustStoreCrlsChanged;
+    case kTrustFileCa:
+    case kTrustFileSigningPolicy:
+    case kTrustFileNamespaces:
+      return kTrustStoreCasChanged;
+    default:
+      return kTrustStoreUnchanged;
+  }
+}
+
+
+void TrustStore::Watch() {
+  if (m_inotify_fd < 0)
+    return;
+  const uint32_t mask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+                        IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB |
+                        IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+  if (inotify_add_watch(m_inotify_fd, m_cert_dir.c_str(), mask) < 0) {
+    LogAuthz(kLogAuthzDebug, "failed to watch %s (%d)",
+             m_cert_dir.c_str(), errno);
+  }
+}
+
+
+unsigned TrustStore::LoadAll() {
+  unsigned changes = kTrustStoreUnchanged;
+  set<string> present;
+  DIR *dirp = opendir(m_cert_dir.c_str());
+  if (dirp == NULL) {
+    LogAuthz(kLogAuthzDebug | kLogAuthzSyslogErr,
+             "failed to open trusted certificates directory %s (%d)",
+             m_cert_dir.c_str(), errno);
+  } else {
+    struct dirent *dent;
+    while ((dent = readdir(dirp)) != NULL) {
+      const string name(dent->d_name);
+      if (ClassifyTrustFile(name) == kTrustFileUnknown)
+        continue;
+      present.insert(name);
+      changes |= LoadFile(name);
+    }
+    closedir(dirp);
+  }
+
+  vector<string> stale;
+  for (map<string, File>::const_iterator it = m_files.begin();
+       it != m_files.end(); ++it)
+  {
+    if (present.find(it->first) == present.end())
+      stale.push_back(it->first);
+  }
+  for (unsigned i = 0; i < stale.size(); ++i)
+    changes |= RemoveFile(stale[i]);
+
+  struct stat info;
+  if (stat(m_cert_dir.c_str(), &info) == 0)
+    m_dir_mtime = info.st_mtim;
+  return changes;
+}
+
+
+unsigned TrustStore::RemoveFile(const string &name) {
+  map<string, File>::iterator it = m_files.find(name);
+  if (it == m_files.end())
+    return kTrustStoreUnchanged;
+  const unsigned change = ChangeOf(it->second.kind);
+  FreeFile(&it->second);
+  m_files.erase(it);
+  return change;
+}
+
+
+unsigned TrustStore::LoadFile(const string &name) {
+  const TrustFileKind kind = ClassifyTrustFile(name);
+  const string path = m_cert_dir + "/" + name;
+  unsigned changes = RemoveFile(name);
+
+  File file;
+  file.kind = kind;
+  char target[PATH_MAX];
+  ssize_t target_len = readlink(path.c_str(), target, sizeof(target) - 1);
+  if (target_len > 0) {
+    target[target_len] = '\0';
+    const char *base = strrchr(target, '/');
+    file.target = base ? base + 1 : target;
+  }
+
+  BIO *bio = BIO_new_file(path.c_str(), "r");
+  if (bio == NULL) {
+    // Vanished in the meantime
+    return changes;
+  }
+  if ((kind == kTrustFileSigningPolicy) || (kind == kTrustFileNamespaces)) {
+    char buf[4096];
+    int nbytes;
+    while ((nbytes = BIO_read(bio, buf, sizeof(buf))) > 0)
+      file.text.append(buf, nbytes);
+  } else {
+    STACK_OF(X509_INFO) *infos =
+      PEM_X509_INFO_read_bio(bio, NULL, NULL, NULL);
+    for (int i = 0; infos && (i < sk_X509_INFO_num(infos)); ++i) {
+      X509_INFO *info = sk_X509_INFO_value(infos, i);
+      if (info->x509 && (kind == kTrustFileCa)) {
+        file.certs.push_back(info->x509);
+        info->x509 = NULL;
+      }
+      if (info->crl && (kind == kTrustFileCrl)) {
+        file.crls.push_back(info->crl);
+        info->crl = NULL;
+      }
+    }
+    if (infos)
+      sk_X509_INFO_pop_free(infos, X509_INFO_free);
+    if ((kind == kTrustFileCrl) && file.crls.empty()) {
+      // fetch-crl may be configured to store DER CRLs
+      BIO_reset(bio);
+      X509_CRL *crl = d2i_X509_CRL_bio(bio, NULL);
+      if (crl)
+        file.crls.push_back(crl);
+    }
+    ERR_clear_error();
+    if (file.certs.empty() && file.crls.empty()) {
+      LogAuthz(kLogAuthzDebug, "no certificate or CRL found in %s",
+               path.c_str());
+    }
+  }
+  BIO_free(bio);
+
+  m_files[name] = file;
+  return changes | ChangeOf(kind);
+}
+
+
+unsigned TrustStore::Refresh() {
+  const unsigned changes =
+    m_bundle_path.empty() ? RefreshDirectory() : MapBundle();
+  if ((changes & kTrustStoreCrlsChanged) && m_bundle_path.empty())
+    IndexRevocations();
+  if (changes != kTrustStoreUnchanged)
+    FreeStore();
+  return changes;
+}
+
+
+void TrustStore::IndexRevocations() {
+  vector<RevokedKey> keys;
+  for (map<string, File>::const_iterator it = m_files.begin();
+       it != m_files.end(); ++it)
+  {
+    for (unsigned i = 0; i < it->second.crls.size(); ++i)
+      AddRevokedKeys(it->second.crls[i], &keys);
+  }
+  BuildRevocationTable(keys, &m_revoked);
+  LogAuthz(kLogAuthzDebug, "indexed %u revoked certificates",
+           static_cast<unsigned>(keys.size()));
+}
+
+
+unsigned TrustStore::RefreshDirectory() {
+  if (m_inotify_fd < 0) {
+    struct stat info;
+    if ((stat(m_cert_dir.c_str(), &info) == 0) &&
+        (info.st_mtim.tv_sec == m_dir_mtime.tv_sec) &&
+        (info.st_mtim.tv_nsec == m_dir_mtime.tv_nsec))
+    {
+      return kTrustStoreUnchanged;
+    }
+    return LoadAll();
+  }
+
+  set<string> changed;
+  bool reload_all = false;
+  char buf[4096]
+    __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  while (true) {
+    ssize_t nbytes = read(m_inotify_fd, buf, sizeof(buf));
+    if (nbytes <= 0) {
+      if ((nbytes < 0) && (errno == EINTR))
+        continue;
+      break;
+    }
+    for (char *ptr = buf; ptr < buf + nbytes; ) {
+      const struct inotify_event *event =
+        reinterpret_cast<const struct inotify_event *>(ptr);
+      if (event->mask &
+          (IN_Q_OVERFLOW | IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF))
+      {
+        reload_all = true;
+      } else if (event->len > 0) {
+        changed.insert(string(event->name));
+      }
+      ptr += sizeof(struct inotify_event) + event->len;
+    }
+  }
+
+  if (reload_all) {
+    LogAuthz(kLogAuthzDebug, "reloading trust store %s", m_cert_dir.c_str());
+    Watch();
+    return LoadAll() | kTrustStoreDirReplaced;
+  }
+
+  unsigned changes = kTrustStoreUnchanged;
+  for (set<string>::const_iterator it = changed.begin();
+       it != changed.end(); ++it)
+  {
+    if (ClassifyTrustFile(*it) != kTrustFileUnknown) {
+      changes |= LoadFile(*it);
+      continue;
+    }
+    // The hashed names are often symlinks to <alias>.pem or <alias>.crl
+    vector<string> dependents;
+    for (map<string, File>::const_iterator i = m_files.begin();
+         i != m_files.end(); ++i)
+    {
+      if (i->second.target == *it)
+        dependents.push_back(i->first);
+    }
+    for (unsigned i = 0; i < dependents.size(); ++i)
+      changes |= LoadFile(dependents[i]);
+  }
+  if (changes != kTrustStoreUnchanged) {
+    LogAuthz(kLogAuthzDebug, "trust store %s changed (%u)",
+             m_cert_dir.c_str(), changes);
+  }
+  return changes;
+}
+
+
+bool TrustStore::IsRevoked(X509 *cert) const {
+  const RevokedKey key = MakeRevokedKey(X509_get_issuer_name(cert),
+                                        X509_get_serialNumber(cert));
+  if (m_bundle)
+    return m_bundle->IsRevoked(key);
+  return FindRevokedKey(&m_revoked[0], m_revoked.size(), key);
+}
+
+void TrustStore::FreeStore() {
+  if (m_store)
+    X509_STORE_free(m_store);
+  m_store = NULL;
+  m_store_entries.clear();
+}
+
+
+/**
+ * Called by OpenSSL when a certificate or CRL is not yet in the store.  For
+ * CRLs, OpenSSL asks every time, so entries that were added before are
+ * skipped; the store finds them in its cache.
+ */
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+int TrustStore::LookupInBundle(X509_LOOKUP *lookup, X509_LOOKUP_TYPE type,
+                               const X509_NAME *name, X509_OBJECT *ret)
+#else
+int TrustStore::LookupInBundle(X509_LOOKUP *lookup, X509_LOOKUP_TYPE type,
+                               X509_NAME *name, X509_OBJECT *ret)
+#endif
+{
+  TrustStore *trust_store = g_trust_store;
+  if (!trust_store || !trust_store->m_bundle ||
+      ((type != X509_LU_X509) && (type != X509_LU_CRL)))
+  {
+    return 0;
+  }
+  X509_STORE *store = X509_LOOKUP_get_store(lookup);
+  X509_NAME *subject = const_cast<X509_NAME *>(name);
+  vector<BundleBlob> blobs;
+  trust_store->m_bundle->Find(X509_NAME_hash(subject),
+                              (type == X509_LU_CRL) ? kTrustFileCrl
+                                                    : kTrustFileCa,
+                              &blobs);
+  int found = 0;
+  for (unsigned i = 0; i < blobs.size(); ++i) {
+    if (trust_store->m_store_entries.count(blobs[i].index) > 0)
+      continue;
+    trust_store->m_store_entries.insert(blobs[i].index);
+    const unsigned char *der = blobs[i].data;
+    if (type == X509_LU_CRL) {
+      X509_CRL *crl = d2i_X509_CRL(NULL, &der, blobs[i].length);
+      if (!crl)
+        continue;
+      if (X509_NAME_cmp(X509_CRL_get_issuer(crl), subject) == 0) {
+        X509_STORE_add_crl(store, crl);
+        if (!found)
+          found = X509_OBJECT_set1_X509_CRL(ret, crl);
+      }
+      X509_CRL_free(crl);
+    } else {
+      X509 *cert = d2i_X509(NULL, &der, blobs[i].length);
+      if (!cert)
+        continue;
+      if (X509_NAME_cmp(X509_get_subject_name(cert), subject) == 0) {
+        X509_STORE_add_cert(store, cert);
+        if (!found)
+          found = X509_OBJECT_set1_X509(ret, cert);
+      }
+      X509_free(cert);
+    }
+  }
+  ERR_clear_error();
+  return found;
+}
+
+
+X509_STORE *TrustStore::GetStore() {
+  if (m_store)
+    return m_store;
+  m_store = X509_STORE_new();
+  if (!m_store)
+    return NULL;
+
+  if (m_bundle) {
+    if (!m_lookup_method) {
+      m_lookup_method = X509_LOOKUP_meth_new("cvmfs trust bundle");
+      X509_LOOKUP_meth_set_get_by_subject(m_lookup_method, LookupInBundle);
+    }
+    X509_STORE_add_lookup(m_store, m_lookup_method);
+    return m_store;
+  }
+
+  for (map<string, File>::const_iterator it = m_files.begin();
+       it != m_files.end(); ++it)
+  {
+    for (unsigned i = 0; i < it->second.certs.size(); ++i)
+      X509_STORE_add_cert(m_store, it->second.certs[i]);
+    for (unsigned i = 0; i < it->second.crls.size(); ++i)
+      X509_STORE_add_crl(m_store, it->second.crls[i]);
+  }
+  ERR_clear_error();
+  return m_store;
+}
+
+
+bool TrustStore::GetSigningPolicy(X509 *ca, string *policy) const {
+  const unsigned long hash = X509_NAME_hash(X509_get_subject_name(ca));
+  if (m_bundle) {
+    vector<BundleBlob> blobs;
+    m_bundle->Find(hash, kTrustFileSigningPolicy, &blobs);
+    if (blobs.empty())
+      return false;
+    policy->assign(reinterpret_cast<const char *>(blobs[0].data),
+                   blobs[0].length);
+    return true;
+  }
+  char name[32];
+  snprintf(name, sizeof(name), "%08lx.signing_policy", hash);
+  map<string, File>::const_iterator it = m_files.find(name);
+  if (it == m_files.end())
+    return false;
+  *policy = it->second.text;
+  return true;
+}
+
+
+TrustStore *TrustStore::g_trust_store = NULL;
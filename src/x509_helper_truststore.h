@@ -0,0 +1,126 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_AUTHZ_X509_HELPER_TRUSTSTORE_H_
+#define CVMFS_AUTHZ_X509_HELPER_TRUSTSTORE_H_
+
+#include <openssl/x509.h>
+#include <openssl/x509_vfy.h>
+#include <time.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "x509_helper_bundle.h"
+#include "x509_helper_revocation.h"
+
+/**
+ * Changes reported by TrustStore::Refresh()
+ */
+const unsigned kTrustStoreUnchanged   = 0x00;
+const unsigned kTrustStoreCrlsChanged = 0x01;
+const unsigned kTrustStoreCasChanged  = 0x02;
+const unsigned kTrustStoreDirReplaced = 0x04;
+
+/**
+ * In-memory copy of the trusted certificates directory: CA certificates
+ * (<hash>.<n>), CRLs (<hash>.r<n>), signing policies and namespaces files.
+ * It is read once and then kept up to date through inotify, so that only the
+ * files that actually changed are read again.
+ *
+ * The directory is taken from $X509_CERT_DIR and defaults to
+ * /etc/grid-security/certificates.  If $CVMFS_X509_TRUST_BUNDLE points to a
+ * bundle built by cvmfs_x509_bundle_builder, the bundle is mapped instead and
+ * nothing is read from the directory.  The bundle is remapped when it is
+ * replaced.
+ */
+class TrustStore {
+ public:
+  static TrustStore *GetInstance() {
+    if (!g_trust_store)
+      g_trust_store = new TrustStore();
+    return g_trust_store;
+  }
+
+  /**
+   * Applies pending changes of the certificates directory.  Returns a
+   * combination of kTrustStore... flags.
+   */
+  unsigned Refresh();
+  /**
+   * True if one of the loaded CRLs of the certificate's issuer lists it.
+   * This is a lookup in the revocation index, which is rebuilt whenever a CRL
+   * changes (or taken from the bundle).
+   */
+  bool IsRevoked(X509 *cert) const;
+  /**
+   * An OpenSSL store with the CA certificates and CRLs, owned by the trust
+   * store and valid until the next Refresh() that reports a change.  In
+   * bundle mode, certificates and CRLs are decoded on demand.
+   */
+  X509_STORE *GetStore();
+  /**
+   * The signing policy file of a CA, if there is one.
+   */
+  bool GetSigningPolicy(X509 *ca, std::string *policy) const;
+
+  const std::string &cert_dir() const {return m_cert_dir;}
+
+ private:
+  struct File {
+    File() : kind(kTrustFileUnknown) {}
+    TrustFileKind kind;
+    // Basename of the symlink target, if the file is a symlink
+    std::string target;
+    std::vector<X509 *> certs;
+    std::vector<X509_CRL *> crls;
+    std::string text;
+  };
+
+  TrustStore();
+  TrustStore(const TrustStore&);
+  ~TrustStore();
+
+  void Watch();
+  unsigned MapBundle();
+  void UnmapBundle();
+  unsigned RefreshDirectory();
+  void FreeStore();
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+  static int LookupInBundle(X509_LOOKUP *lookup, X509_LOOKUP_TYPE type,
+                            const X509_NAME *name, X509_OBJECT *ret);
+#else
+  static int LookupInBundle(X509_LOOKUP *lookup, X509_LOOKUP_TYPE type,
+                            X509_NAME *name, X509_OBJECT *ret);
+#endif
+  void IndexRevocations();
+  unsigned LoadAll();
+  unsigned LoadFile(const std::string &name);
+  unsigned RemoveFile(const std::string &name);
+  static void FreeFile(File *file);
+  static unsigned ChangeOf(TrustFileKind kind);
+
+  std::string m_cert_dir;
+  std::string m_bundle_path;
+  TrustBundle *m_bundle;
+  std::map<std::string, File> m_files;
+  std::vector<RevokedKey> m_revoked;
+  X509_STORE *m_store;
+  /**
+   * Bundle entries that have already been added to m_store
+   */
+  std::set<uint32_t> m_store_entries;
+  X509_LOOKUP_METHOD *m_lookup_method;
+  int m_inotify_fd;
+  /**
+   * Without inotify, the directory is reloaded when its mtime changes
+   */
+  struct timespec m_dir_mtime;
+
+  static TrustStore *g_trust_store;
+};
+
+#endif  // CVMFS_AUTHZ_X509_HELPER_TRUSTSTORE_H_
@@ -0,0 +1,84 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+#include "x509_helper_ttl.h"
+
+#include <unistd.h>
+
+#include <cstdlib>
+
+#include "x509_helper_log.h"
+#include "x509_helper_lru.h"
+
+using namespace std;  // NOLINT
+
+namespace {
+
+const unsigned kDefaultMaxTtl = 600;
+const unsigned kMinFailureTtl = 5;
+const unsigned kMaxFailureTtl = 60;
+/**
+ * A failure counts as repeated if it reoccurs within this window.
+ */
+const time_t kFailureWindow = 600;
+const unsigned kFailureCapacity = 256;
+
+LruCache<string, unsigned> *g_failures = NULL;
+
+
+unsigned GetMaxTtl() {
+  static unsigned max_ttl = 0;
+  if (max_ttl == 0) {
+    max_ttl = kDefaultMaxTtl;
+    const char *env = getenv("CVMFS_X509_MAX_TTL");
+    if (env != NULL) {
+      char *end;
+      const unsigned long value = strtoul(env, &end, 10);  // NOLINT
+      if ((*env != '\0') && (*end == '\0') && (value > 0))
+        max_ttl = value;
+    }
+  }
+  return max_ttl;
+}
+
+
+unsigned GetJitter(unsigned ttl) {
+  static bool seeded = false;
+  if (!seeded) {
+    srandom(time(NULL) ^ getpid());
+    seeded = true;
+  }
+  const unsigned range = ttl / 10;
+  if (range == 0)
+    return 0;
+  return random() % (range + 1);
+}
+
+}  // anonymous namespace
+
+
+unsigned GetSuccessTtl(time_t not_after) {
+  const time_t now = time(NULL);
+  // Unknown (0) or past expiry: the decision must not be reused
+  if (not_after <= now)
+    return 1;
+  unsigned ttl = GetMaxTtl();
+  if (not_after - now < static_cast<time_t>(ttl))
+    ttl = not_after - now;
+  ttl -= GetJitter(ttl);
+  return (ttl > 0) ? ttl : 1;
+}
+
+
+unsigned GetFailureTtl(const string &key) {
+  if (g_failures == NULL)
+    g_failures = new LruCache<string, unsigned>(kFailureCapacity);
+
+  unsigned ttl = kMinFailureTtl;
+  const unsigned *previous = g_failures->Lookup(key);
+  if (previous != NULL)
+    ttl = (*previous >= kMaxFailureTtl / 2) ? kMaxFailureTtl : 2 * *previous;
+  g_failures->Insert(key, ttl, time(NULL) + kFailureWindow);
+  LogAuthz(kLogAuthzDebug, "failure ttl is %u seconds", ttl);
+  return ttl;
+}
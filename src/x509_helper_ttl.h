@@ -0,0 +1,31 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_AUTHZ_X509_HELPER_TTL_H_
+#define CVMFS_AUTHZ_X509_HELPER_TTL_H_
+
+#include <time.h>
+
+#include <string>
+
+/**
+ * TTL in seconds for which the cvmfs client may reuse a positive decision on
+ * a credential that expires at not_after.  The remaining validity is capped
+ * by CVMFS_X509_MAX_TTL (default 600 seconds) and shortened by up to 10%
+ * random jitter, so that clients sharing a credential do not all come back at
+ * the same moment.  If the expiry is unknown (0) or already past, the TTL is
+ * one second.
+ */
+unsigned GetSuccessTtl(time_t not_after);
+
+/**
+ * TTL in seconds for a negative reply.  The key identifies the failure (e.g.
+ * the uid without a proxy or the fingerprint of an invalid proxy); every
+ * repetition within a few minutes doubles the TTL, starting from 5 seconds up
+ * to one minute.  A one-off failure thus clears quickly, while a persistently
+ * broken credential is not re-checked on every file access.
+ */
+unsigned GetFailureTtl(const std::string &key);
+
+#endif  // CVMFS_AUTHZ_X509_HELPER_TTL_H_
@@ -3,8 +3,19 @@
  */
 #include "x509_helper_voms.h"
 
+#include <openssl/x509v3.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+#include "x509_helper_digest.h"
 #include "x509_helper_dynlib.h"
 #include "x509_helper_log.h"
+#include "x509_helper_vomsac.h"
+
+using namespace std;  // NOLINT
 
 
 extern "C" {
@@ -19,6 +30,7 @@ int (*g_VOMS_Export)(char **buffer, int *buflen, struct vomsdata *vd,
                      int *error) = NULL;
 int (*g_VOMS_Import)(char *buffer, int buflen, struct vomsdata *vd,
                      int *error) = NULL;
+int (*g_VOMS_DeleteAll)(struct vomsdata *vd, int *error) = NULL;
 
 }
 
@@ -33,17 +45,38 @@ void VomsLib::Load() {
       !LoadSymbol(m_libvoms_handle, &g_VOMS_ErrorMessage,
                                                     "VOMS_ErrorMessage") ||
       !LoadSymbol(m_libvoms_handle, &g_VOMS_Export, "VOMS_Export") ||
-      !LoadSymbol(m_libvoms_handle, &g_VOMS_Import, "VOMS_Import")
+      !LoadSymbol(m_libvoms_handle, &g_VOMS_Import, "VOMS_Import") ||
+      !LoadSymbol(m_libvoms_handle, &g_VOMS_DeleteAll, "VOMS_DeleteAll")
      ) {
         g_VOMS_Init = NULL;
         return;
   }
+  // Attribute certificates are carried in this proxy extension
+  m_ac_oid = OBJ_txt2obj("1.3.6.1.4.1.8005.100.100.5", 1);
+  m_context = (*g_VOMS_Init)(NULL, NULL);
+  if (!m_ac_oid || !m_context) {
+    LogAuthz(kLogAuthzDebug, "Failed to initialize VOMS context");
+    return;
+  }
+  const char *parser = getenv("CVMFS_X509_VOMS_PARSER");
+  if (parser && (strcmp(parser, "native") == 0)) {
+    LogAuthz(kLogAuthzDebug, "Using native VOMS AC parser");
+    m_native_parser = new VomsAcParser();
+  }
   LogAuthz(kLogAuthzDebug, "Successfully loaded VOMS library");
   m_zombie = false;
 }
 
 
 void VomsLib::Close() {
+  if (m_context)
+    (*g_VOMS_Destroy)(m_context);
+  m_context = NULL;
+  ASN1_OBJECT_free(m_ac_oid);
+  m_ac_oid = NULL;
+  m_attributes.Clear();
+  delete m_native_parser;
+  m_native_parser = NULL;
   CloseDynLib(&m_libvoms_handle, "VOMS");
   g_VOMS_Init = NULL;
   g_VOMS_Destroy = NULL;
@@ -51,6 +84,147 @@ void VomsLib::Close() {
   g_VOMS_ErrorMessage = NULL;
   g_VOMS_Export = NULL;
   g_VOMS_Import = NULL;
+  g_VOMS_DeleteAll = NULL;
+}
+
+
+static string DerEncode(X509 *cert) {
+  unsigned char *der = NULL;
+  int der_len = i2d_X509(cert, &der);
+  if (der_len <= 0)
+    return "";
+  string result(reinterpret_cast<char *>(der), der_len);
+  OPENSSL_free(der);
+  return result;
+}
+
+
+/**
+ * VOMS hands out the AC validity as generalized time strings.
+ */
+static time_t GeneralizedTimeToTime(const char *date) {
+  if (!date)
+    return 0;
+  ASN1_GENERALIZEDTIME *asn1_time = ASN1_GENERALIZEDTIME_new();
+  int days, seconds;
+  time_t result = 0;
+  if (asn1_time && ASN1_GENERALIZEDTIME_set_string(asn1_time, date) &&
+      ASN1_TIME_diff(&days, &seconds, NULL, asn1_time))
+  {
+    result = time(NULL) + static_cast<time_t>(days) * 86400 + seconds;
+  }
+  ASN1_GENERALIZEDTIME_free(asn1_time);
+  return result;
+}
+
+
+/**
+ * Concatenation of the AC extensions of all certificates in the chain, the
+ * same ones that VOMS_Retrieve() looks at with RECURSE_CHAIN.
+ */
+void VomsLib::GetAcExtensions(X509 *cert, STACK_OF(X509) *chain,
+                              vector<string> *extensions) const
+{
+  extensions->clear();
+  for (int i = -1; i < sk_X509_num(chain); ++i) {
+    X509 *c = (i < 0) ? cert : sk_X509_value(chain, i);
+    int pos = X509_get_ext_by_OBJ(c, m_ac_oid, -1);
+    if (pos < 0)
+      continue;
+    const ASN1_OCTET_STRING *value =
+      X509_EXTENSION_get_data(X509_get_ext(c, pos));
+    extensions->push_back(
+      string(reinterpret_cast<const char *>(ASN1_STRING_get0_data(value)),
+             ASN1_STRING_length(value)));
+  }
+}
+
+
+bool VomsLib::Retrieve(X509 *cert, STACK_OF(X509) *chain,
+                       vector<VomsAttributes> *attributes, time_t *not_after)
+{
+  int voms_error = 0;
+  (*g_VOMS_DeleteAll)(m_context, &voms_error);
+  voms_error = 0;
+  const int retval = (*g_VOMS_Retrieve)(cert, chain, RECURSE_CHAIN,
+                                        m_context, &voms_error);
+  if (!retval) {
+    if (voms_error == VERR_NOEXT)
+      return true;
+    char *err_str = (*g_VOMS_ErrorMessage)(m_context, voms_error, NULL, 0);
+    LogAuthz(kLogAuthzDebug, "Unable to parse VOMS file: %s\n", err_str);
+    free(err_str);
+    return false;
+  }
+
+  for (int idx = 0; m_context->data && m_context->data[idx]; ++idx) {
+    const struct voms *ac = m_context->data[idx];
+    const time_t ac_not_after = GeneralizedTimeToTime(ac->date2);
+    if (ac_not_after < *not_after)
+      *not_after = ac_not_after;
+    if (!ac->voname)
+      continue;
+    VomsAttributes vo_attributes;
+    vo_attributes.voname = ac->voname;
+    for (int idx2 = 0; ac->std && ac->std[idx2]; ++idx2) {
+      const struct data *fqan = ac->std[idx2];
+      if (!fqan->group)
+        continue;
+      VomsFqan entry;
+      entry.group = fqan->group;
+      entry.role = fqan->role ? fqan->role : "NULL";
+      vo_attributes.fqans.push_back(entry);
+    }
+    attributes->push_back(vo_attributes);
+  }
+  return true;
+}
+
+
+/**
+ * An AC is bound to its holder, so the holder's certificate is part of the
+ * key: the same AC presented with a different EEC is verified again.
+ */
+bool VomsLib::GetAttributes(X509 *cert, STACK_OF(X509) *chain, X509 *eec,
+                            FqanIndex *fqans, time_t *not_after)
+{
+  *fqans = FqanIndex();
+  if (m_zombie)
+    return false;
+  vector<string> extensions;
+  GetAcExtensions(cert, chain, &extensions);
+  if (extensions.empty())
+    return true;
+
+  string acs;
+  for (unsigned i = 0; i < extensions.size(); ++i)
+    acs += extensions[i];
+  const string key = Sha256(acs) + Sha256(DerEncode(eec));
+  const CachedAttributes *cached = m_attributes.Lookup(key);
+  if (cached) {
+    LogAuthz(kLogAuthzDebug, "using cached VOMS attributes");
+  } else {
+    CachedAttributes result;
+    result.not_after = numeric_limits<time_t>::max();
+    vector<VomsAttributes> attributes;
+    if (!m_native_parser ||
+        !m_native_parser->Parse(extensions, eec, &attributes,
+                                &result.not_after))
+    {
+      if (m_native_parser)
+        LogAuthz(kLogAuthzDebug, "falling back to libvomsapi");
+      attributes.clear();
+      if (!Retrieve(cert, chain, &attributes, &result.not_after))
+        return false;
+    }
+    result.fqans.Build(attributes);
+    const time_t expiry = time(NULL) + kMaxLifetime;
+    cached = m_attributes.Insert(key, result, min(result.not_after, expiry));
+  }
+  *fqans = cached->fqans;
+  if (cached->not_after < *not_after)
+    *not_after = cached->not_after;
+  return true;
 }
 
 VomsLib *VomsLib::g_voms = NULL;
@@ -5,9 +5,16 @@
 #ifndef CVMFS_AUTHZ_X509_HELPER_VOMS_H_
 #define CVMFS_AUTHZ_X509_HELPER_VOMS_H_
 
+#include <time.h>
+
+#include <string>
+#include <vector>
+
 #include "voms/voms_apic.h"
 
+#include "x509_helper_fqan.h"
 #include "x509_helper_log.h"
+#include "x509_helper_lru.h"
 
 extern "C" {
 // VOMS API declarations
@@ -21,29 +28,60 @@ extern int (*g_VOMS_Export)(char **buffer, int *buflen, struct vomsdata *vd,
                             int *error);
 extern int (*g_VOMS_Import)(char *buffer, int buflen, struct vomsdata *vd,
                             int *error);
+extern int (*g_VOMS_DeleteAll)(struct vomsdata *vd, int *error);
 }
 
 
+/**
+ * Group and role of an FQAN; a missing role is stored as "NULL", as VOMS
+ * itself does.
+ */
+struct VomsFqan {
+  std::string group;
+  std::string role;
+};
+
+struct VomsAttributes {
+  std::string voname;
+  std::vector<VomsFqan> fqans;
+};
+
+
 struct authz_data {
-  struct vomsdata *voms_;
+  // Empty if the proxy has no VOMS extension
+  FqanIndex fqans_;
   char *dn_;
+  // dn_ as a string, for matching DN rules (see AddDnRule())
+  std::string subject_;
+  // Earliest expiry of any certificate or attribute certificate in the chain
+  time_t not_after_;
 
   authz_data() :
-    voms_(NULL),
-    dn_(NULL)
+    dn_(NULL),
+    not_after_(0)
   {}
 
   ~authz_data() {
-    if (voms_ && g_VOMS_Destroy) {(*g_VOMS_Destroy)(voms_);}
     if (dn_) {free(dn_);}
   }
 };
 
 
+class VomsAcParser;
+
+/**
+ * With CVMFS_X509_VOMS_PARSER=native, attribute certificates are decoded and
+ * verified by VomsAcParser, and libvomsapi is only used for ACs that the
+ * native parser does not accept.  The default is to use libvomsapi only.
+ */
 class VomsLib {
  public:
   VomsLib()
     : m_zombie(true)
+    , m_context(NULL)
+    , m_ac_oid(NULL)
+    , m_native_parser(NULL)
+    , m_attributes(kCapacity)
   {
     Load();
     LogAuthz(kLogAuthzDebug | kLogAuthzSyslog,
@@ -60,13 +98,48 @@ class VomsLib {
     return g_voms;
   }
 
+  /**
+   * Verifies the VOMS attribute certificates found in the proxy chain and
+   * returns their FQANs; no FQANs means no VOMS extension.
+   * Verified attributes are cached by the attribute certificates and the
+   * holder's certificate (eec), so that an AC presented again is not
+   * verified again before it expires.  not_after is lowered to the end of
+   * the AC validity.  Returns false if the ACs cannot be verified.
+   */
+  bool GetAttributes(X509 *cert, STACK_OF(X509) *chain, X509 *eec,
+                     FqanIndex *fqans, time_t *not_after);
+
  private:
+  struct CachedAttributes {
+    FqanIndex fqans;
+    time_t not_after;
+  };
+
+  /**
+   * Upper bound on the lifetime of cached attributes so that changes of the
+   * vomsdir are eventually picked up.
+   */
+  static const time_t kMaxLifetime = 3600;
+  static const unsigned kCapacity = 128;
+
   VomsLib(const VomsLib&);
   void Load();
   void Close();
+  void GetAcExtensions(X509 *cert, STACK_OF(X509) *chain,
+                       std::vector<std::string> *extensions) const;
+  bool Retrieve(X509 *cert, STACK_OF(X509) *chain,
+                std::vector<VomsAttributes> *attributes, time_t *not_after);
 
   bool m_zombie;
   void *m_libvoms_handle;
+  /**
+   * Long-lived VOMS context; libvomsapi keeps the vomsdir settings in it, so
+   * it is set up once and only emptied between requests.
+   */
+  struct vomsdata *m_context;
+  ASN1_OBJECT *m_ac_oid;
+  VomsAcParser *m_native_parser;
+  LruCache<std::string, CachedAttributes> m_attributes;
   static VomsLib *g_voms;
 };
 
@@ -0,0 +1,575 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+#include "x509_helper_vomsac.h"
+
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/objects.h>
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "x509_helper_log.h"
+#include "x509_helper_truststore.h"
+
+using namespace std;  // NOLINT
+
+/**
+ * One DER encoded TLV inside the extension value.
+ */
+struct DerNode {
+  const unsigned char *start;
+  const unsigned char *content;
+  long length;  // of the content
+  long total;  // of the whole TLV
+  int tag;
+  int xclass;
+  bool constructed;
+};
+
+// Object identifiers used by VOMS
+static const char *kOidVomsAttribute = "1.3.6.1.4.1.8005.100.100.4";
+static const char *kOidVomsCerts = "1.3.6.1.4.1.8005.100.100.10";
+static const char *kOidVomsTags = "1.3.6.1.4.1.8005.100.100.11";
+static const char *kOidAuthorityKeyId = "2.5.29.35";
+static const char *kOidNoRevAvail = "2.5.29.56";
+
+
+static bool ReadDer(const unsigned char **pos, const unsigned char *end,
+                    DerNode *node)
+{
+  if (*pos >= end)
+    return false;
+  const unsigned char *p = *pos;
+  long length;
+  int tag, xclass;
+  const int ret = ASN1_get_object(&p, &length, &tag, &xclass, end - *pos);
+  // Error, or indefinite length which is not DER
+  if ((ret & 0x80) || (ret == (V_ASN1_CONSTRUCTED | 1))) {
+    ERR_clear_error();
+    return false;
+  }
+  node->start = *pos;
+  node->content = p;
+  node->length = length;
+  node->total = (p - *pos) + length;
+  node->tag = tag;
+  node->xclass = xclass;
+  node->constructed = (ret & V_ASN1_CONSTRUCTED) != 0;
+  *pos = p + length;
+  return true;
+}
+
+
+static bool GetChildren(const DerNode &node, vector<DerNode> *children) {
+  children->clear();
+  if (!node.constructed)
+    return false;
+  const unsigned char *pos = node.content;
+  const unsigned char *end = node.content + node.length;
+  while (pos < end) {
+    DerNode child;
+    if (!ReadDer(&pos, end, &child))
+      return false;
+    children->push_back(child);
+  }
+  return true;
+}
+
+
+static bool IsUniversal(const DerNode &node, int tag) {
+  return (node.xclass == V_ASN1_UNIVERSAL) && (node.tag == tag);
+}
+
+
+static bool IsContext(const DerNode &node, int tag) {
+  return (node.xclass == V_ASN1_CONTEXT_SPECIFIC) && (node.tag == tag);
+}
+
+
+static string GetOid(const DerNode &node) {
+  if (!IsUniversal(node, V_ASN1_OBJECT))
+    return "";
+  const unsigned char *p = node.start;
+  ASN1_OBJECT *obj = d2i_ASN1_OBJECT(NULL, &p, node.total);
+  if (!obj) {
+    ERR_clear_error();
+    return "";
+  }
+  char buf[128];
+  const int len = OBJ_obj2txt(buf, sizeof(buf), obj, 1);
+  ASN1_OBJECT_free(obj);
+  if ((len <= 0) || (len >= static_cast<int>(sizeof(buf))))
+    return "";
+  return buf;
+}
+
+
+static bool GetTime(const DerNode &node, time_t *result) {
+  if (!IsUniversal(node, V_ASN1_GENERALIZEDTIME))
+    return false;
+  const unsigned char *p = node.start;
+  ASN1_GENERALIZEDTIME *asn1_time =
+    d2i_ASN1_GENERALIZEDTIME(NULL, &p, node.total);
+  int days, seconds;
+  const bool retval =
+    asn1_time && ASN1_TIME_diff(&days, &seconds, NULL, asn1_time);
+  ASN1_GENERALIZEDTIME_free(asn1_time);
+  ERR_clear_error();
+  if (retval)
+    *result = time(NULL) + static_cast<time_t>(days) * 86400 + seconds;
+  return retval;
+}
+
+
+/**
+ * The directoryName ([4]) of a GeneralNames sequence, owned by the caller.
+ */
+static X509_NAME *GetDirectoryName(const DerNode &general_names) {
+  vector<DerNode> names;
+  if (!GetChildren(general_names, &names))
+    return NULL;
+  for (unsigned i = 0; i < names.size(); ++i) {
+    vector<DerNode> name;
+    if (!IsContext(names[i], 4) || !GetChildren(names[i], &name) ||
+        (name.size() != 1))
+    {
+      continue;
+    }
+    const unsigned char *p = name[0].start;
+    X509_NAME *result = d2i_X509_NAME(NULL, &p, name[0].total);
+    ERR_clear_error();
+    return result;
+  }
+  return NULL;
+}
+
+
+/**
+ * The uniformResourceIdentifier ([6]) of a GeneralNames sequence
+ */
+static string GetUri(const DerNode &general_names) {
+  vector<DerNode> names;
+  if (!GetChildren(general_names, &names))
+    return "";
+  for (unsigned i = 0; i < names.size(); ++i) {
+    if (IsContext(names[i], 6) && !names[i].constructed) {
+      return string(reinterpret_cast<const char *>(names[i].content),
+                    names[i].length);
+    }
+  }
+  return "";
+}
+
+
+static string GetDn(X509_NAME *name) {
+  char *dn = X509_NAME_oneline(name, NULL, 0);
+  if (!dn)
+    return "";
+  string result(dn);
+  OPENSSL_free(dn);
+  return result;
+}
+
+
+/**
+ * An AC is a sequence whose first element (the AC info) starts with the
+ * version number.
+ */
+static bool IsAc(const DerNode &node) {
+  vector<DerNode> children, info;
+  return IsUniversal(node, V_ASN1_SEQUENCE) &&
+         GetChildren(node, &children) && !children.empty() &&
+         IsUniversal(children[0], V_ASN1_SEQUENCE) &&
+         GetChildren(children[0], &info) && !info.empty() &&
+         IsUniversal(info[0], V_ASN1_INTEGER);
+}
+
+
+/**
+ * Splits "/vo/group/Role=role/Capability=NULL" like libvomsapi does.
+ */
+static VomsFqan SplitFqan(const string &fqan) {
+  VomsFqan result;
+  const size_t role_pos = fqan.find("/Role=");
+  if (role_pos == string::npos) {
+    const size_t cap_pos = fqan.find("/Capability=");
+    result.group = fqan.substr(0, cap_pos);
+    result.role = "NULL";
+    return result;
+  }
+  result.group = fqan.substr(0, role_pos);
+  const size_t role_start = role_pos + 6;
+  const size_t role_end = fqan.find('/', role_start);
+  result.role = fqan.substr(role_start, role_end == string::npos ?
+                                        string::npos : role_end - role_start);
+  return result;
+}
+
+
+static bool IsSafePathComponent(const string &name) {
+  return !name.empty() && (name[0] != '.') &&
+         (name.find('/') == string::npos);
+}
+
+
+VomsAcParser::VomsAcParser() {
+  const char *voms_dir = getenv("X509_VOMS_DIR");
+  m_voms_dir = voms_dir ? voms_dir : "/etc/grid-security/vomsdir";
+}
+
+
+/**
+ * An LSC file lists the DNs of the VOMS server certificate and of its chain
+ * of issuers, one per line.  Lines starting with '-' separate alternative
+ * chains.
+ */
+bool VomsAcParser::MatchesLsc(const string &path, STACK_OF(X509) *signers) {
+  FILE *fp = fopen(path.c_str(), "r");
+  if (!fp) {
+    LogAuthz(kLogAuthzDebug, "cannot open LSC file %s", path.c_str());
+    return false;
+  }
+  string content;
+  char buf[4096];
+  size_t nbytes;
+  while ((nbytes = fread(buf, 1, sizeof(buf), fp)) > 0)
+    content.append(buf, nbytes);
+  fclose(fp);
+
+  vector<vector<string> > chains(1);
+  size_t start = 0;
+  while (start < content.length()) {
+    size_t end = content.find('\n', start);
+    if (end == string::npos)
+      end = content.length();
+    string line = content.substr(start, end - start);
+    start = end + 1;
+    while (!line.empty() && isspace(line[line.length() - 1]))
+      line.erase(line.length() - 1);
+    if (line.empty())
+      continue;
+    if (line[0] == '-')
+      chains.push_back(vector<string>());
+    else
+      chains.back().push_back(line);
+  }
+
+  const int nsigners = sk_X509_num(signers);
+  for (unsigned i = 0; i < chains.size(); ++i) {
+    const vector<string> &dns = chains[i];
+    if (dns.empty() || (dns.size() > static_cast<unsigned>(nsigners) + 1))
+      continue;
+    bool matches =
+      (dns[0] == GetDn(X509_get_subject_name(sk_X509_value(signers, 0))));
+    for (unsigned j = 1; matches && (j < dns.size()); ++j) {
+      matches =
+        (dns[j] == GetDn(X509_get_issuer_name(sk_X509_value(signers, j - 1))));
+    }
+    if (matches)
+      return true;
+  }
+  LogAuthz(kLogAuthzDebug, "VOMS server certificate does not match %s",
+           path.c_str());
+  return false;
+}
+
+
+/**
+ * As for the proxy chain, CAs without a CRL are accepted.
+ */
+static int VerifyCallback(int ok, X509_STORE_CTX *ctx) {
+  if (!ok && (X509_STORE_CTX_get_error(ctx) == X509_V_ERR_UNABLE_TO_GET_CRL))
+    return 1;
+  return ok;
+}
+
+
+bool VomsAcParser::VerifySigner(const string &vo, const string &host,
+                                X509_NAME *issuer, STACK_OF(X509) *signers)
+{
+  if (!IsSafePathComponent(vo) || !IsSafePathComponent(host) ||
+      (sk_X509_num(signers) == 0))
+  {
+    return false;
+  }
+  X509 *signer = sk_X509_value(signers, 0);
+  if (X509_NAME_cmp(issuer, X509_get_subject_name(signer)) != 0)
+    return false;
+  if (!MatchesLsc(m_voms_dir + "/" + vo + "/" + host + ".lsc", signers))
+    return false;
+
+  // Same trust anchors and CRL checks as for the proxy chain, see
+  // VerifyProxyChain()
+  X509_STORE *store = TrustStore::GetInstance()->GetStore();
+  X509_STORE_CTX *ctx = X509_STORE_CTX_new();
+  bool retval = false;
+  if (store && ctx && X509_STORE_CTX_init(ctx, store, signer, signers)) {
+    X509_STORE_CTX_set_flags(ctx, X509_V_FLAG_CRL_CHECK |
+                                  X509_V_FLAG_CRL_CHECK_ALL);
+    X509_STORE_CTX_set_verify_cb(ctx, VerifyCallback);
+    retval = (X509_verify_cert(ctx) == 1);
+    if (!retval) {
+      LogAuthz(kLogAuthzDebug, "cannot verify VOMS server certificate: %s",
+               X509_verify_cert_error_string(X509_STORE_CTX_get_error(ctx)));
+    }
+  }
+  X509_STORE_CTX_free(ctx);
+  ERR_clear_error();
+  return retval;
+}
+
+
+/**
+ *   AttributeCertificate ::= SEQUENCE { acinfo, signatureAlgorithm, signature }
+ *   AttributeCertificateInfo ::= SEQUENCE {
+ *     version, holder, issuer, signature, serialNumber,
+ *     attrCertValidityPeriod, attributes, issuerUniqueID OPTIONAL,
+ *     extensions OPTIONAL }
+ */
+bool VomsAcParser::ParseAc(const DerNode &ac, X509 *eec,
+                           VomsAttributes *attributes, time_t *not_after)
+{
+  vector<DerNode> ac_parts, info;
+  if (!GetChildren(ac, &ac_parts) || (ac_parts.size() != 3) ||
+      !GetChildren(ac_parts[0], &info) || (info.size() < 7))
+  {
+    return false;
+  }
+  const DerNode &signature_alg = ac_parts[1];
+  const DerNode &signature = ac_parts[2];
+
+  // Holder: baseCertificateID [0] IssuerSerial must name the EEC
+  vector<DerNode> holder, issuer_serial;
+  if (!GetChildren(info[1], &holder) || holder.empty() ||
+      !IsContext(holder[0], 0) ||
+      !GetChildren(holder[0], &issuer_serial) || (issuer_serial.size() < 2) ||
+      !IsUniversal(issuer_serial[1], V_ASN1_INTEGER))
+  {
+    return false;
+  }
+  X509_NAME *holder_issuer = GetDirectoryName(issuer_serial[0]);
+  const unsigned char *p = issuer_serial[1].start;
+  ASN1_INTEGER *holder_serial =
+    d2i_ASN1_INTEGER(NULL, &p, issuer_serial[1].total);
+  const bool is_holder = holder_issuer && holder_serial &&
+    (X509_NAME_cmp(holder_issuer, X509_get_issuer_name(eec)) == 0) &&
+    (ASN1_INTEGER_cmp(holder_serial, X509_get0_serialNumber(eec)) == 0);
+  X509_NAME_free(holder_issuer);
+  ASN1_INTEGER_free(holder_serial);
+  if (!is_holder) {
+    LogAuthz(kLogAuthzDebug, "AC holder is not the EEC");
+    return false;
+  }
+
+  // Issuer: v2Form [0] with issuerName
+  vector<DerNode> v2form;
+  if (!IsContext(info[2], 0) || !GetChildren(info[2], &v2form) ||
+      v2form.empty())
+  {
+    return false;
+  }
+
+  // The signature algorithm must be the same inside and outside acinfo
+  if ((info[3].total != signature_alg.total) ||
+      memcmp(info[3].start, signature_alg.start, signature_alg.total))
+  {
+    return false;
+  }
+
+  vector<DerNode> validity;
+  time_t ac_not_before, ac_not_after;
+  if (!GetChildren(info[5], &validity) || (validity.size() != 2) ||
+      !GetTime(validity[0], &ac_not_before) ||
+      !GetTime(validity[1], &ac_not_after))
+  {
+    return false;
+  }
+  const time_t now = time(NULL);
+  if ((now < ac_not_before) || (now > ac_not_after)) {
+    LogAuthz(kLogAuthzDebug, "AC is not valid at this time");
+    return false;
+  }
+
+  // Attributes: the VOMS attribute is an IetfAttrSyntax with the
+  // "vo://host:port" policy authority and the FQANs as octet strings
+  vector<DerNode> attrs;
+  if (!GetChildren(info[6], &attrs))
+    return false;
+  string policy_authority;
+  attributes->fqans.clear();
+  for (unsigned i = 0; i < attrs.size(); ++i) {
+    vector<DerNode> attr, values;
+    if (!GetChildren(attrs[i], &attr) || (attr.size() != 2))
+      return false;
+    if (GetOid(attr[0]) != kOidVomsAttribute)
+      continue;
+    if (!GetChildren(attr[1], &values))
+      return false;
+    for (unsigned j = 0; j < values.size(); ++j) {
+      vector<DerNode> syntax, fqans;
+      if (!GetChildren(values[j], &syntax) || (syntax.size() != 2) ||
+          !IsContext(syntax[0], 0) || !GetChildren(syntax[1], &fqans))
+      {
+        return false;
+      }
+      const string uri = GetUri(syntax[0]);
+      if (uri.empty() ||
+          (!policy_authority.empty() && (uri != policy_authority)))
+      {
+        return false;
+      }
+      policy_authority = uri;
+      for (unsigned k = 0; k < fqans.size(); ++k) {
+        if (!IsUniversal(fqans[k], V_ASN1_OCTET_STRING))
+          return false;
+        attributes->fqans.push_back(SplitFqan(string(
+          reinterpret_cast<const char *>(fqans[k].content),
+          fqans[k].length)));
+      }
+    }
+  }
+  const size_t sep = policy_authority.find("://");
+  if (sep == string::npos)
+    return false;
+  attributes->voname = policy_authority.substr(0, sep);
+  string host = policy_authority.substr(sep + 3);
+  host = host.substr(0, host.find(':'));
+
+  // Extensions: the VOMS server certificate chain comes along in ACCERTS
+  STACK_OF(X509) *signers = sk_X509_new_null();
+  bool extensions_valid = (signers != NULL);
+  if (extensions_valid && (info.size() > 7)) {
+    const DerNode &last = info[info.size() - 1];
+    vector<DerNode> extensions;
+    if (!IsUniversal(last, V_ASN1_SEQUENCE) ||
+        !GetChildren(last, &extensions))
+    {
+      extensions_valid = false;
+    }
+    for (unsigned i = 0; extensions_valid && (i < extensions.size()); ++i) {
+      vector<DerNode> ext;
+      if (!GetChildren(extensions[i], &ext) || (ext.size() < 2)) {
+        extensions_valid = false;
+        break;
+      }
+      const string oid = GetOid(ext[0]);
+      const bool critical = (ext.size() == 3) &&
+        IsUniversal(ext[1], V_ASN1_BOOLEAN) && (ext[1].length == 1) &&
+        (ext[1].content[0] != 0);
+      const DerNode &value = ext[ext.size() - 1];
+      if (oid == kOidVomsCerts) {
+        const unsigned char *pos = value.content;
+        DerNode certs_seq;
+        vector<DerNode> certs_outer, certs;
+        if (!IsUniversal(value, V_ASN1_OCTET_STRING) ||
+            !ReadDer(&pos, value.content + value.length, &certs_seq) ||
+            !GetChildren(certs_seq, &certs_outer) ||
+            (certs_outer.size() != 1) ||
+            !GetChildren(certs_outer[0], &certs))
+        {
+          extensions_valid = false;
+          break;
+        }
+        for (unsigned j = 0; j < certs.size(); ++j) {
+          const unsigned char *der = certs[j].start;
+          X509 *cert = d2i_X509(NULL, &der, certs[j].total);
+          if (!cert) {
+            extensions_valid = false;
+            break;
+          }
+          sk_X509_push(signers, cert);
+        }
+      } else if (critical && (oid != kOidVomsTags) &&
+                 (oid != kOidAuthorityKeyId) && (oid != kOidNoRevAvail))
+      {
+        LogAuthz(kLogAuthzDebug, "unsupported critical AC extension %s",
+                 oid.c_str());
+        extensions_valid = false;
+      }
+    }
+  }
+
+  X509_NAME *issuer = GetDirectoryName(v2form[0]);
+  bool verified = extensions_valid && issuer &&
+                  VerifySigner(attributes->voname, host, issuer, signers);
+  X509_NAME_free(issuer);
+
+  // Signature over the DER encoded acinfo
+  if (verified) {
+    int md_nid, pkey_nid;
+    vector<DerNode> alg;
+    const EVP_MD *md = NULL;
+    if (GetChildren(signature_alg, &alg) && !alg.empty()) {
+      const int sig_nid = OBJ_txt2nid(GetOid(alg[0]).c_str());
+      if ((sig_nid != NID_undef) &&
+          OBJ_find_sigid_algs(sig_nid, &md_nid, &pkey_nid) &&
+          (md_nid != NID_undef))
+      {
+        md = EVP_get_digestbynid(md_nid);
+      }
+    }
+    EVP_MD_CTX *md_ctx = EVP_MD_CTX_new();
+    EVP_PKEY *pkey = X509_get0_pubkey(sk_X509_value(signers, 0));
+    verified = md && md_ctx && pkey &&
+      IsUniversal(signature, V_ASN1_BIT_STRING) && (signature.length > 1) &&
+      (signature.content[0] == 0) &&
+      (EVP_DigestVerifyInit(md_ctx, NULL, md, NULL, pkey) == 1) &&
+      (EVP_DigestVerifyUpdate(md_ctx, ac_parts[0].start,
+                              ac_parts[0].total) == 1) &&
+      (EVP_DigestVerifyFinal(md_ctx, signature.content + 1,
+                             signature.length - 1) == 1);
+    EVP_MD_CTX_free(md_ctx);
+    ERR_clear_error();
+    if (!verified)
+      LogAuthz(kLogAuthzDebug, "cannot verify AC signature");
+  }
+  sk_X509_pop_free(signers, X509_free);
+
+  if (verified && (ac_not_after < *not_after))
+    *not_after = ac_not_after;
+  return verified;
+}
+
+
+bool VomsAcParser::Parse(const vector<string> &extensions, X509 *eec,
+                         vector<VomsAttributes> *attributes,
+                         time_t *not_after)
+{
+  attributes->clear();
+  time_t ac_not_after = *not_after;
+  for (unsigned i = 0; i < extensions.size(); ++i) {
+    // The extension holds SEQUENCE { SEQUENCE OF AttributeCertificate }
+    const unsigned char *pos =
+      reinterpret_cast<const unsigned char *>(extensions[i].data());
+    const unsigned char *end = pos + extensions[i].length();
+    DerNode outer;
+    vector<DerNode> acs;
+    if (!ReadDer(&pos, end, &outer) || (pos != end) ||
+        !GetChildren(outer, &acs))
+    {
+      return false;
+    }
+    if ((acs.size() == 1) && !IsAc(acs[0])) {
+      DerNode inner = acs[0];
+      if (!GetChildren(inner, &acs))
+        return false;
+    }
+    for (unsigned j = 0; j < acs.size(); ++j) {
+      VomsAttributes ac_attributes;
+      if (!IsAc(acs[j]) ||
+          !ParseAc(acs[j], eec, &ac_attributes, &ac_not_after))
+      {
+        return false;
+      }
+      attributes->push_back(ac_attributes);
+    }
+  }
+  if (attributes->empty())
+    return false;
+  *not_after = ac_not_after;
+  return true;
+}
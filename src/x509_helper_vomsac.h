@@ -0,0 +1,53 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_AUTHZ_X509_HELPER_VOMSAC_H_
+#define CVMFS_AUTHZ_X509_HELPER_VOMSAC_H_
+
+#include <openssl/x509.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include "x509_helper_voms.h"
+
+struct DerNode;
+
+/**
+ * Decodes VOMS attribute certificates (RFC 5755) straight from the proxy's
+ * AC extension with OpenSSL, without going through the libvomsapi object
+ * model.  An AC is only accepted if
+ *   - its holder is the EEC and it is within its validity period,
+ *   - the VOMS server certificate shipped with it matches the LSC file in
+ *     the vomsdir ($X509_VOMS_DIR, default /etc/grid-security/vomsdir) and
+ *     chains up to a CA of the TrustStore, checked against its CRLs,
+ *   - its signature verifies and it has no unknown critical extensions.
+ * Anything else, including unsupported but possibly valid ACs, makes Parse()
+ * fail, in which case the caller falls back to libvomsapi.
+ */
+class VomsAcParser {
+ public:
+  VomsAcParser();
+
+  /**
+   * Takes the values of the AC extensions in the proxy chain.  not_after is
+   * lowered to the end of the AC validity.
+   */
+  bool Parse(const std::vector<std::string> &extensions, X509 *eec,
+             std::vector<VomsAttributes> *attributes, time_t *not_after);
+
+ private:
+  VomsAcParser(const VomsAcParser&);
+
+  bool ParseAc(const DerNode &ac, X509 *eec, VomsAttributes *attributes,
+               time_t *not_after);
+  bool VerifySigner(const std::string &vo, const std::string &host,
+                    X509_NAME *issuer, STACK_OF(X509) *signers);
+  bool MatchesLsc(const std::string &path, STACK_OF(X509) *signers);
+
+  std::string m_voms_dir;
+};
+
+#endif  // CVMFS_AUTHZ_X509_HELPER_VOMSAC_H_
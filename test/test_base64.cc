@@ -0,0 +1,203 @@
+/**
+ * This file is part of the CernVM File System.
+ *
+ * Checks the Base64 codec against OpenSSL's encoder.  Built twice: with the
+ * vectorized loops, which are then also checked one by one, and without
+ * them (test_base64_scalar), so that all paths are compared with the same
+ * reference.
+ */
+
+#include <openssl/evp.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "x509_helper_base64.h"
+#include "x509_helper_base64_simd.h"
+
+using namespace std;  // NOLINT
+
+namespace {
+
+unsigned g_failures = 0;
+
+#define CHECK(cond) do { \
+  if (!(cond)) { \
+    fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    ++g_failures; \
+  } \
+} while (0)
+
+
+const unsigned kMaxLength = 1024;
+const char kAlphabet[] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+typedef size_t (*EncodeLoop)(const unsigned char *src, size_t length,
+                             char *dst);
+typedef size_t (*DecodeLoop)(const char *src, size_t length,
+                             unsigned char *dst);
+
+struct SimdPath {
+  const char *name;
+  size_t block;  ///< Characters per decoded block
+  EncodeLoop encode;
+  DecodeLoop decode;
+};
+
+
+string RandomBytes(size_t length) {
+  string result(length, '\0');
+  for (size_t i = 0; i < length; ++i)
+    result[i] = static_cast<char>(random() & 0xff);
+  return result;
+}
+
+
+string Reference(const string &data) {
+  vector<unsigned char> buf((data.length() + 2) / 3 * 4 + 1);
+  const int length = EVP_EncodeBlock(&buf[0],
+    reinterpret_cast<const unsigned char *>(data.data()), data.length());
+  return string(reinterpret_cast<char *>(&buf[0]), length);
+}
+
+
+bool IsBase64Char(unsigned char c) {
+  return (c != '\0') && (strchr(kAlphabet, c) != NULL);
+}
+
+
+vector<SimdPath> GetSimdPaths() {
+  vector<SimdPath> paths;
+#if defined(HAVE_BASE64_SSE41) || defined(HAVE_BASE64_AVX2)
+  __builtin_cpu_init();
+#endif
+#ifdef HAVE_BASE64_SSE41
+  if (__builtin_cpu_supports("sse4.1")) {
+    SimdPath path = {"SSE4.1", 16, Base64EncodeSse41, Base64DecodeSse41};
+    paths.push_back(path);
+  }
+#endif
+#ifdef HAVE_BASE64_AVX2
+  if (__builtin_cpu_supports("avx2")) {
+    SimdPath path = {"AVX2", 32, Base64EncodeAvx2, Base64DecodeAvx2};
+    paths.push_back(path);
+  }
+#endif
+  return paths;
+}
+
+
+/**
+ * Whatever prefix a vectorized loop consumes must match the reference.
+ * The decoder must not consume the block with the padding.
+ */
+void CheckSimdPath(const SimdPath &path, const string &data,
+                   const string &encoded)
+{
+  vector<char> chars(encoded.length() + 1);
+  const size_t nbytes = path.encode(
+    reinterpret_cast<const unsigned char *>(data.data()), data.length(),
+    &chars[0]);
+  CHECK(nbytes % 3 == 0);
+  CHECK(nbytes <= data.length());
+  const size_t nchars_encoded = nbytes / 3 * 4;
+  CHECK(string(&chars[0], nchars_encoded) ==
+        encoded.substr(0, nchars_encoded));
+
+  vector<unsigned char> bytes(encoded.length() / 4 * 3 + kBase64DecodeSlack);
+  const size_t nchars = path.decode(encoded.data(), encoded.length(),
+                                    &bytes[0]);
+  CHECK(nchars % path.block == 0);
+  CHECK(nchars <= encoded.length());
+  if ((data.length() % 3) != 0)
+    CHECK(nchars + 4 <= encoded.length());
+  CHECK(string(reinterpret_cast<char *>(&bytes[0]), nchars / 4 * 3) ==
+        data.substr(0, nchars / 4 * 3));
+}
+
+
+void TestRoundTrip(const vector<SimdPath> &paths) {
+  for (unsigned length = 0; length <= kMaxLength; ++length) {
+    const string data = RandomBytes(length);
+    const string encoded = Reference(data);
+    CHECK(Base64(data) == encoded);
+    string decoded = "garbage";
+    CHECK(Debase64(encoded, &decoded));
+    CHECK(decoded == data);
+    for (unsigned i = 0; i < paths.size(); ++i)
+      CheckSimdPath(paths[i], data, encoded);
+  }
+}
+
+
+/**
+ * Every byte outside of the alphabet at any position (with padding only at
+ * the end) makes the input invalid; the vectorized loops must stop before
+ * the block that contains it.
+ */
+void TestInvalidCharacters(const vector<SimdPath> &paths) {
+  const string encoded = Reference(RandomBytes(3 * 40));
+  string decoded;
+  for (unsigned c = 0; c < 256; ++c) {
+    if (IsBase64Char(c))
+      continue;
+    // A '=' in the last position is valid padding
+    const unsigned end = encoded.length() - ((c == '=') ? 1 : 0);
+    for (unsigned pos = 0; pos < end; ++pos) {
+      string invalid = encoded;
+      invalid[pos] = static_cast<char>(c);
+      CHECK(!Debase64(invalid, &decoded));
+      for (unsigned i = 0; i < paths.size(); ++i) {
+        vector<unsigned char> bytes(invalid.length() / 4 * 3 +
+                                    kBase64DecodeSlack);
+        const size_t nchars = paths[i].decode(invalid.data(),
+                                              invalid.length(), &bytes[0]);
+        CHECK(nchars <= pos);
+      }
+    }
+  }
+}
+
+
+void TestPadding() {
+  const char *invalid[] = {
+    "=", "==", "===", "====", "A===", "AA=A", "A=AA", "=AAA", "AAA==",
+    "AAAA=", "AAAA====", "AA==AAAA", "AAA=AAAA", "AAAAAAAAAAAAAAAAAAA=AAAA",
+    "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA=AAAA",
+    "AAA", "AAAAA", "AA=", "A"};
+  string decoded;
+  for (unsigned i = 0; i < sizeof(invalid) / sizeof(invalid[0]); ++i) {
+    if (Debase64(invalid[i], &decoded)) {
+      fprintf(stderr, "accepted %s\n", invalid[i]);
+      ++g_failures;
+    }
+  }
+  CHECK(Debase64("", &decoded) && decoded.empty());
+  CHECK(Debase64("QQ==", &decoded) && (decoded == "A"));
+  CHECK(Debase64("QUI=", &decoded) && (decoded == "AB"));
+  CHECK(Debase64("QUJD", &decoded) && (decoded == "ABC"));
+}
+
+}  // anonymous namespace
+
+
+int main() {
+  srandom(42);
+  const vector<SimdPath> paths = GetSimdPaths();
+  for (unsigned i = 0; i < paths.size(); ++i)
+    printf("checking %s\n", paths[i].name);
+
+  TestRoundTrip(paths);
+  TestInvalidCharacters(paths);
+  TestPadding();
+
+  if (g_failures > 0) {
+    fprintf(stderr, "%u checks failed\n", g_failures);
+    return 1;
+  }
+  return 0;
+}
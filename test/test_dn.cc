@@ -0,0 +1,145 @@
+/**
+ * This file is part of the CernVM File System.
+ *
+ * Checks the spellings of DN rules and the lookups in DnSet, with and
+ * without the Bloom filter.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "x509_helper_dn.h"
+
+using namespace std;  // NOLINT
+
+namespace {
+
+unsigned g_failures = 0;
+
+#define CHECK(cond) do { \
+  if (!(cond)) { \
+    fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    ++g_failures; \
+  } \
+} while (0)
+
+
+/**
+ * True if the subject matches the rule as the membership check does it
+ */
+bool Matches(const string &rule, const string &subject) {
+  vector<string> dns;
+  AddDnRule(rule, &dns);
+  DnSet set;
+  set.Build(dns);
+  return set.Contains(subject);
+}
+
+
+void TestDnRules() {
+  // As written
+  CHECK(Matches("/DC=org/CN=Alice", "/DC=org/CN=Alice"));
+  CHECK(!Matches("/DC=org/CN=Alice", "/DC=org/CN=Alic"));
+  CHECK(!Matches("/DC=org/CN=Alice", "/DC=org/CN=Alice/CN=proxy"));
+  CHECK(!Matches("/DC=org/CN=Alice", "/dc=org/CN=Alice"));
+
+  // DOS line endings; no other white space is removed
+  CHECK(Matches("/DC=org/CN=Alice\r", "/DC=org/CN=Alice"));
+  CHECK(!Matches("/DC=org/CN=Alice\r", "/DC=org/CN=Alice\r"));
+  CHECK(!Matches("/DC=org/CN=Alice ", "/DC=org/CN=Alice"));
+  CHECK(!Matches("/DC=org/CN=Alice\t", "/DC=org/CN=Alice"));
+  CHECK(Matches("/DC=org/CN=Alice ", "/DC=org/CN=Alice "));
+
+  // Legacy names of the e-mail attribute
+  const string subject = "/DC=org/CN=Alice/emailAddress=alice@example.org";
+  CHECK(Matches("/DC=org/CN=Alice/E=alice@example.org", subject));
+  CHECK(Matches("/DC=org/CN=Alice/Email=alice@example.org", subject));
+  CHECK(Matches("/DC=org/CN=Alice/emailAddress=alice@example.org", subject));
+  CHECK(Matches("/E=alice@example.org/CN=Alice",
+                "/emailAddress=alice@example.org/CN=Alice"));
+  CHECK(Matches("/DC=org/E=a/CN=Alice/Email=b\r",
+                "/DC=org/emailAddress=a/CN=Alice/emailAddress=b"));
+  CHECK(!Matches("/DC=org/CN=Alice/EMAIL=alice@example.org", subject));
+  CHECK(!Matches("/DC=org/CN=Alice/e=alice@example.org", subject));
+  CHECK(!Matches("/DC=org/CN=Alice/Emails=alice@example.org", subject));
+
+  // A value that contains "/E=": the rule still matches as written ...
+  CHECK(Matches("/DC=org/CN=Alice/E=x", "/DC=org/CN=Alice/E=x"));
+  // ... and an empty value is not assumed, so here "/E=x" is the value of CN
+  CHECK(Matches("/DC=org/CN=/E=x", "/DC=org/CN=/E=x"));
+  CHECK(!Matches("/DC=org/CN=/E=x", "/DC=org/CN=/emailAddress=x"));
+  // Only the spelling of attribute names changes, never the values
+  CHECK(Matches("/CN=a/E=b/E=c", "/CN=a/emailAddress=b/emailAddress=c"));
+  CHECK(!Matches("/CN=a/E=b/E=c", "/CN=a/emailAddress=b/E=c"));
+  CHECK(!Matches("/CN=E=b", "/CN=emailAddress=b"));
+  CHECK(!Matches("/CN=x E=b", "/CN=x emailAddress=b"));
+  CHECK(!Matches("//E=b", "//emailAddress=b"));
+
+  // The subject is not normalized
+  CHECK(!Matches("/DC=org/CN=Alice/emailAddress=a", "/DC=org/CN=Alice/E=a"));
+  CHECK(!Matches("/DC=org/CN=Alice/emailAddress=a",
+                 "/DC=org/CN=Alice/Email=a"));
+}
+
+
+string RandomDn(unsigned i) {
+  char buf[128];
+  snprintf(buf, sizeof(buf), "/DC=org/DC=example/OU=%ld/CN=User %u",
+           random() % 100, i);
+  return buf;
+}
+
+
+void TestDnSet(unsigned size) {
+  vector<string> dns;
+  set<string> members;
+  for (unsigned i = 0; i < size; ++i) {
+    dns.push_back(RandomDn(i));
+    members.insert(dns.back());
+  }
+  // Duplicates are fine
+  if (size > 0)
+    dns.push_back(dns[0]);
+  DnSet dn_set;
+  dn_set.Build(dns);
+  CHECK(dn_set.empty() == (size == 0));
+
+  for (unsigned i = 0; i < dns.size(); ++i) {
+    CHECK(dn_set.Contains(dns[i]));
+    // Near misses
+    CHECK(!dn_set.Contains(dns[i] + " "));
+    CHECK(!dn_set.Contains(dns[i] + "/CN=proxy"));
+    const string prefix = dns[i].substr(0, dns[i].length() - 1);
+    CHECK(dn_set.Contains(prefix) == (members.count(prefix) > 0));
+  }
+  CHECK(!dn_set.Contains(""));
+
+  // Everything else misses, whether or not the Bloom filter lets it pass
+  for (unsigned i = 0; i < 100000; ++i) {
+    const string dn = RandomDn(size + random() % (2 * size + 10));
+    CHECK(dn_set.Contains(dn) == (members.count(dn) > 0));
+  }
+}
+
+}  // anonymous namespace
+
+
+int main() {
+  srandom(42);
+  TestDnRules();
+  TestDnSet(0);
+  TestDnSet(1);
+  TestDnSet(100);
+  // Large enough for the Bloom filter
+  TestDnSet(256);
+  TestDnSet(5000);
+
+  if (g_failures > 0) {
+    fprintf(stderr, "%u checks failed\n", g_failures);
+    return 1;
+  }
+  return 0;
+}
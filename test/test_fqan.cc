@@ -0,0 +1,165 @@
+/**
+ * This file is part of the CernVM File System.
+ *
+ * Compares FqanIndex::Matches() with the loop over all FQANs of the VO that
+ * it replaced, on random FQANs and queries.  The reference uses the baseline
+ * IsSubgroupOf() and IsRoleMatching().  Queries are built the way
+ * MembershipRules passes them: any_role for a missing or "NULL" role,
+ * otherwise the role itself.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "x509_helper_fqan.h"
+#include "x509_helper_voms.h"
+
+using namespace std;  // NOLINT
+
+namespace {
+
+const unsigned kIterations = 500000;
+
+//------------------------------------------------------------------------------
+// Baseline
+
+
+bool
+IsSubgroupOf(const vector<string> &group1, const vector<string> &group2) {
+  if (group1.size() < group2.size()) {
+    return false;
+  }
+  vector<string>::const_iterator it1 = group1.begin();
+  for (vector<string>::const_iterator it2 = group2.begin();
+       it2 != group2.end();
+       it1++, it2++)
+  {
+    if (*it1 != *it2) {return false;}
+  }
+  return true;
+}
+
+
+bool
+IsRoleMatching(const char *role1, const char *role2) {
+  if ((role2 == NULL) || (strlen(role2) == 0) ||
+      !strcmp(role2, "NULL"))
+  {
+    return true;
+  }
+  if ((role1 == NULL) || !strcmp(role1, "NULL")) {return false;}
+
+  return !strcmp(role1, role2);
+}
+
+
+bool MatchesFqans(const vector<VomsAttributes> &attributes,
+                  const string &vo, const vector<string> &group_hierarchy,
+                  const string &role)
+{
+  for (unsigned idx = 0; idx < attributes.size(); idx++) {
+    const VomsAttributes *it = &attributes[idx];
+    if (strcmp(vo.c_str(), it->voname.c_str())) {continue;}
+
+    for (unsigned idx2 = 0; idx2 < it->fqans.size(); idx2++) {
+      const VomsFqan *it2 = &it->fqans[idx2];
+      vector<string> avail_hierarchy;
+      SplitGroupToPaths(it2->group, &avail_hierarchy);
+      if (IsSubgroupOf(avail_hierarchy, group_hierarchy) &&
+          IsRoleMatching(it2->role.c_str(), role.c_str()))
+      {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+
+//------------------------------------------------------------------------------
+// Random FQANs and queries
+
+
+template <typename T, unsigned N>
+const T &Pick(const T (&choices)[N]) {
+  return choices[random() % N];
+}
+
+const char *kVos[] = {"atlas", "cms", "dteam", ""};
+const char *kGroupParts[] = {"atlas", "cms", "prod", "analysis", "sw", "a",
+                             ""};
+const char *kRoles[] = {"pilot", "production", "lcgadmin"};
+
+
+vector<string> RandomHierarchy(const string &vo) {
+  vector<string> hierarchy;
+  if (random() % 8 != 0)
+    hierarchy.push_back(vo);
+  const unsigned depth = random() % 4;
+  for (unsigned i = 0; i < depth; ++i)
+    hierarchy.push_back(Pick(kGroupParts));
+  return hierarchy;
+}
+
+
+string ToGroup(const vector<string> &hierarchy) {
+  string group;
+  for (unsigned i = 0; i < hierarchy.size(); ++i)
+    group += "/" + hierarchy[i];
+  return group;
+}
+
+
+vector<VomsAttributes> RandomAttributes() {
+  vector<VomsAttributes> attributes;
+  const unsigned nvos = random() % 4;
+  for (unsigned i = 0; i < nvos; ++i) {
+    VomsAttributes vo;
+    vo.voname = Pick(kVos);
+    const unsigned nfqans = random() % 8;
+    for (unsigned j = 0; j < nfqans; ++j) {
+      VomsFqan fqan;
+      fqan.group = ToGroup(RandomHierarchy(vo.voname));
+      fqan.role = (random() % 2) ? "NULL" : Pick(kRoles);
+      vo.fqans.push_back(fqan);
+    }
+    attributes.push_back(vo);
+  }
+  return attributes;
+}
+
+}  // anonymous namespace
+
+
+int main() {
+  srandom(42);
+  unsigned nmatches = 0;
+  unsigned nfailures = 0;
+  for (unsigned i = 0; i < kIterations; ++i) {
+    const vector<VomsAttributes> attributes = RandomAttributes();
+    FqanIndex index;
+    index.Build(attributes);
+
+    const string vo = Pick(kVos);
+    const vector<string> group = RandomHierarchy(vo);
+    const bool any_role = (random() % 3 == 0);
+    const string role = any_role ? "" : Pick(kRoles);
+
+    const bool expected = MatchesFqans(attributes, vo, group, role);
+    const bool actual = index.Matches(vo, group, any_role, role);
+    if (expected)
+      ++nmatches;
+    if (actual != expected) {
+      fprintf(stderr, "expected %d, got %d for %s:%s/Role=%s\n",
+              expected, actual, vo.c_str(), ToGroup(group).c_str(),
+              any_role ? "NULL" : role.c_str());
+      if (++nfailures >= 10)
+        break;
+    }
+  }
+  printf("%u of %u queries matched\n", nmatches, kIterations);
+  return (nfailures > 0) ? 1 : 0;
+}
@@ -0,0 +1,289 @@
+/**
+ * This file is part of the CernVM File System.
+ *
+ * Compares MembershipRules::Matches() with the rule check it replaced, on
+ * random membership lists and credentials.  The reference is the baseline
+ * CheckSingleAuthz() / CheckMultipleAuthz(), unchanged except that it walks
+ * the VomsAttributes that VomsLib::Retrieve() produces instead of the
+ * struct vomsdata they are copied from.
+ *
+ * DN rules are only generated in the form that both accept; the
+ * normalization of DN rules is covered by test_dn.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "x509_helper_membership.h"
+#include "x509_helper_voms.h"
+
+using namespace std;  // NOLINT
+
+namespace {
+
+const unsigned kIterations = 200000;
+
+//------------------------------------------------------------------------------
+// Baseline
+
+
+void
+SplitGroupToPaths(const string &group, vector<string> *hierarchy) {
+  size_t start = 0, end = 0;
+  while ((end = group.find('/', start)) != std::string::npos) {
+    if (end-start) {
+      hierarchy->push_back(group.substr(start, end-start));
+    }
+    start = end + 1;
+  }
+  if (start != group.size()-1) {hierarchy->push_back(group.substr(start));}
+}
+
+
+bool
+IsSubgroupOf(const vector<string> &group1, const vector<string> &group2) {
+  if (group1.size() < group2.size()) {
+    return false;
+  }
+  vector<string>::const_iterator it1 = group1.begin();
+  for (vector<string>::const_iterator it2 = group2.begin();
+       it2 != group2.end();
+       it1++, it2++)
+  {
+    if (*it1 != *it2) {return false;}
+  }
+  return true;
+}
+
+
+bool
+IsRoleMatching(const char *role1, const char *role2) {
+  if ((role2 == NULL) || (strlen(role2) == 0) ||
+      !strcmp(role2, "NULL"))
+  {
+    return true;
+  }
+  if ((role1 == NULL) || !strcmp(role1, "NULL")) {return false;}
+
+  return !strcmp(role1, role2);
+}
+
+
+/**
+ * voms is NULL for a proxy without VOMS extension
+ */
+bool
+CheckSingleAuthz(const vector<VomsAttributes> *voms, const char *dn,
+                 const string &authz)
+{
+  // An empty entry should authorize nobody.
+  if (authz.empty()) {return false;}
+
+  std::string vo, role, group;
+  bool is_dn = false;
+  if (authz[0] != '/') {
+    size_t delim = authz.find(':');
+    if (delim != std::string::npos) {
+      vo = authz.substr(0, delim);
+      size_t delim2 = authz.find("/Role=", delim+1);
+      if (delim2 != std::string::npos) {
+        role = authz.substr(delim2 + 6);
+        group = authz.substr(delim + 1, delim2 - delim - 1);
+      } else {
+        group = authz.substr(delim + 1);;
+      }
+    }
+  } else {
+    // No VOMS info in the authz; it is a DN.
+    is_dn = true;
+  }
+  // Quick sanity check of group name.
+  if (!group.empty() && group[0] != '/') {return false;}
+
+  vector<string> group_hierarchy;
+  SplitGroupToPaths(group, &group_hierarchy);
+
+  if (is_dn) {
+    return !strcmp(authz.c_str(), dn);
+  }
+  if (!voms) {return false;}
+  for (unsigned idx = 0; idx < voms->size(); idx++) {
+    const VomsAttributes *it = &(*voms)[idx];
+    if (strcmp(vo.c_str(), it->voname.c_str())) {continue;}
+
+    for (unsigned idx2 = 0; idx2 < it->fqans.size(); idx2++) {
+      const VomsFqan *it2 = &it->fqans[idx2];
+      vector<string> avail_hierarchy;
+      SplitGroupToPaths(it2->group, &avail_hierarchy);
+      if (IsSubgroupOf(avail_hierarchy, group_hierarchy) &&
+          IsRoleMatching(it2->role.c_str(), role.c_str()))
+      {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+
+bool
+CheckMultipleAuthz(const vector<VomsAttributes> *voms, const char *dn,
+                   const string &authz_list)
+{
+  size_t last_delim = 0;
+  size_t delim = authz_list.find('\n');
+  while (delim != std::string::npos) {
+    std::string next_authz = authz_list.substr(last_delim, delim-last_delim);
+    last_delim = delim + 1;
+    delim = authz_list.find('\n', last_delim);
+
+    if (CheckSingleAuthz(voms, dn, next_authz)) {return true;}
+  }
+  std::string next_authz = authz_list.substr(last_delim);
+  return CheckSingleAuthz(voms, dn, next_authz);
+}
+
+
+//------------------------------------------------------------------------------
+// Random credentials and membership lists
+
+
+template <typename T, unsigned N>
+const T &Pick(const T (&choices)[N]) {
+  return choices[random() % N];
+}
+
+const char *kVos[] = {"atlas", "cms", "dteam", "atlas.cern.ch", ""};
+const char *kGroupParts[] = {"prod", "analysis", "sw", "Role", "a", "atlas"};
+const char *kRoles[] = {"NULL", "pilot", "production", "lcgadmin", "",
+                        "Role=pilot"};
+const char *kSubjects[] = {"/DC=org/DC=example/CN=Alice",
+                           "/DC=org/DC=example/CN=Bob",
+                           "/DC=org/DC=example/CN=Alice/CN=proxy",
+                           "/C=CH/O=CERN/emailAddress=alice@example.org"};
+
+/**
+ * Mostly well-formed groups of vo, with a few odd ones
+ */
+string RandomGroup(const string &vo) {
+  switch (random() % 10) {
+    case 0: return "";
+    case 1: return "/";
+    case 2: return "//" + vo;
+    case 3: return vo;
+    case 4: return "/" + vo + "/";
+    default: break;
+  }
+  string group = "/" + vo;
+  const unsigned depth = random() % 4;
+  for (unsigned i = 0; i < depth; ++i)
+    group += string("/") + Pick(kGroupParts);
+  return group;
+}
+
+
+vector<VomsAttributes> RandomAttributes() {
+  vector<VomsAttributes> attributes;
+  const unsigned nvos = random() % 4;
+  for (unsigned i = 0; i < nvos; ++i) {
+    VomsAttributes vo;
+    vo.voname = Pick(kVos);
+    const unsigned nfqans = random() % 5;
+    for (unsigned j = 0; j < nfqans; ++j) {
+      VomsFqan fqan;
+      fqan.group = RandomGroup(vo.voname);
+      fqan.role = Pick(kRoles);
+      // libvomsapi reports no role as "NULL"
+      if (fqan.role.empty())
+        fqan.role = "NULL";
+      vo.fqans.push_back(fqan);
+    }
+    attributes.push_back(vo);
+  }
+  return attributes;
+}
+
+
+string RandomRule() {
+  switch (random() % 12) {
+    case 0: return "";
+    case 1: return Pick(kSubjects);
+    case 2: return Pick(kVos);
+    case 3: return ":";
+    case 4: return string(Pick(kVos)) + ":" + Pick(kGroupParts);
+    default: break;
+  }
+  const string vo = Pick(kVos);
+  string rule = vo + ":" + RandomGroup(vo);
+  if (random() % 2)
+    rule += string("/Role=") + Pick(kRoles);
+  return rule;
+}
+
+
+string RandomMembership() {
+  string membership;
+  const unsigned nrules = random() % 6;
+  for (unsigned i = 0; i < nrules; ++i) {
+    if (i > 0)
+      membership += "\n";
+    membership += RandomRule();
+  }
+  if (random() % 8 == 0)
+    membership += "\n";
+  return membership;
+}
+
+
+string Describe(const vector<VomsAttributes> &attributes) {
+  string result;
+  for (unsigned i = 0; i < attributes.size(); ++i) {
+    for (unsigned j = 0; j < attributes[i].fqans.size(); ++j) {
+      result += "  " + attributes[i].voname + ": " +
+                attributes[i].fqans[j].group + " Role=" +
+                attributes[i].fqans[j].role + "\n";
+    }
+  }
+  return result;
+}
+
+}  // anonymous namespace
+
+
+int main() {
+  srandom(42);
+  unsigned nmatches = 0;
+  unsigned nfailures = 0;
+  for (unsigned i = 0; i < kIterations; ++i) {
+    const bool has_voms = (random() % 8 != 0);
+    const vector<VomsAttributes> attributes = RandomAttributes();
+    const string membership = RandomMembership();
+
+    authz_data authz;
+    authz.dn_ = strdup(Pick(kSubjects));
+    authz.subject_ = authz.dn_;
+    if (has_voms)
+      authz.fqans_.Build(attributes);
+
+    const bool expected = CheckMultipleAuthz(has_voms ? &attributes : NULL,
+                                             authz.dn_, membership);
+    const bool actual =
+      MembershipRules("key", membership).Matches(authz);
+    if (expected)
+      ++nmatches;
+    if (actual != expected) {
+      fprintf(stderr, "expected %d, got %d for subject %s, membership\n"
+              "%s\nand FQANs\n%s\n", expected, actual, authz.dn_,
+              membership.c_str(),
+              has_voms ? Describe(attributes).c_str() : "  (none)\n");
+      if (++nfailures >= 10)
+        break;
+    }
+  }
+  printf("%u of %u memberships matched\n", nmatches, kIterations);
+  return (nfailures > 0) ? 1 : 0;
+}
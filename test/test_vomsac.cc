@@ -0,0 +1,646 @@
+/**
+ * This file is part of the CernVM File System.
+ *
+ * Feeds VOMS attribute certificates, issued on the fly by a test CA and a
+ * test VOMS server, to VomsAcParser.  Valid ACs must yield their FQANs and
+ * end of validity; truncated, malformed, foreign, and forged ACs must be
+ * rejected (so that the helper falls back to libvomsapi) without reading out
+ * of bounds.  With --libvomsapi, the results are compared with the ones of
+ * libvomsapi instead; that test is skipped if libvomsapi cannot be loaded.
+ */
+
+#include <openssl/evp.h>
+#include <openssl/objects.h>
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+#include <openssl/x509.h>
+#include <openssl/x509v3.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "x509_helper_dynlib.h"
+#include "x509_helper_fqan.h"
+#include "x509_helper_voms.h"
+#include "x509_helper_vomsac.h"
+
+using namespace std;  // NOLINT
+
+namespace {
+
+const int kSkipTest = 77;
+
+unsigned g_failures = 0;
+
+#define CHECK(cond) do { \
+  if (!(cond)) { \
+    fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    ++g_failures; \
+  } \
+} while (0)
+
+
+//------------------------------------------------------------------------------
+// DER encoding
+
+
+string Der(unsigned char tag, const string &content) {
+  string result(1, static_cast<char>(tag));
+  const size_t length = content.length();
+  if (length < 0x80) {
+    result += static_cast<char>(length);
+  } else {
+    string length_bytes;
+    for (size_t l = length; l > 0; l >>= 8)
+      length_bytes.insert(0, 1, static_cast<char>(l & 0xff));
+    result += static_cast<char>(0x80 | length_bytes.length());
+    result += length_bytes;
+  }
+  return result + content;
+}
+
+string Seq(const string &content) { return Der(0x30, content); }
+
+string Oid(const char *oid) {
+  ASN1_OBJECT *obj = OBJ_txt2obj(oid, 1);
+  unsigned char *der = NULL;
+  const int len = i2d_ASN1_OBJECT(obj, &der);
+  const string result(reinterpret_cast<char *>(der), len);
+  OPENSSL_free(der);
+  ASN1_OBJECT_free(obj);
+  return result;
+}
+
+string Integer(long value) {
+  ASN1_INTEGER *integer = ASN1_INTEGER_new();
+  ASN1_INTEGER_set(integer, value);
+  unsigned char *der = NULL;
+  const int len = i2d_ASN1_INTEGER(integer, &der);
+  const string result(reinterpret_cast<char *>(der), len);
+  OPENSSL_free(der);
+  ASN1_INTEGER_free(integer);
+  return result;
+}
+
+string SerialOf(X509 *cert) {
+  unsigned char *der = NULL;
+  const int len = i2d_ASN1_INTEGER(X509_get_serialNumber(cert), &der);
+  const string result(reinterpret_cast<char *>(der), len);
+  OPENSSL_free(der);
+  return result;
+}
+
+string NameDer(X509_NAME *name) {
+  unsigned char *der = NULL;
+  const int len = i2d_X509_NAME(name, &der);
+  const string result(reinterpret_cast<char *>(der), len);
+  OPENSSL_free(der);
+  return result;
+}
+
+string CertDer(X509 *cert) {
+  unsigned char *der = NULL;
+  const int len = i2d_X509(cert, &der);
+  const string result(reinterpret_cast<char *>(der), len);
+  OPENSSL_free(der);
+  return result;
+}
+
+string GeneralizedTime(time_t t) {
+  struct tm tm;
+  gmtime_r(&t, &tm);
+  char buf[32];
+  strftime(buf, sizeof(buf), "%Y%m%d%H%M%SZ", &tm);
+  return Der(V_ASN1_GENERALIZEDTIME, buf);
+}
+
+/**
+ * GeneralNames with a single directoryName
+ */
+string DirectoryName(X509_NAME *name) {
+  return Seq(Der(0xa4, NameDer(name)));
+}
+
+
+//------------------------------------------------------------------------------
+// Test PKI
+
+
+EVP_PKEY *NewKey() {
+  EVP_PKEY *pkey = NULL;
+  EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, NULL);
+  EVP_PKEY_keygen_init(ctx);
+  EVP_PKEY_CTX_set_rsa_keygen_bits(ctx, 2048);
+  EVP_PKEY_keygen(ctx, &pkey);
+  EVP_PKEY_CTX_free(ctx);
+  return pkey;
+}
+
+void AddExtension(X509 *cert, X509 *issuer, int nid, const char *value) {
+  X509V3_CTX ctx;
+  X509V3_set_ctx(&ctx, issuer, cert, NULL, NULL, 0);
+  X509_EXTENSION *ext =
+    X509V3_EXT_conf_nid(NULL, &ctx, nid, const_cast<char *>(value));
+  X509_add_ext(cert, ext, -1);
+  X509_EXTENSION_free(ext);
+}
+
+/**
+ * Self-signed if issuer is NULL
+ */
+X509 *NewCert(const char *dn, long serial, EVP_PKEY *pkey, bool is_ca,
+              X509 *issuer, EVP_PKEY *issuer_key)
+{
+  X509 *cert = X509_new();
+  X509_set_version(cert, 2);
+  ASN1_INTEGER_set(X509_get_serialNumber(cert), serial);
+  X509_NAME *name = X509_NAME_new();
+  // dn is "/A=a/B=b"
+  const string rdns(dn);
+  size_t pos = 1;
+  while (pos < rdns.length()) {
+    size_t end = rdns.find('/', pos);
+    if (end == string::npos)
+      end = rdns.length();
+    const string rdn = rdns.substr(pos, end - pos);
+    const size_t eq = rdn.find('=');
+    X509_NAME_add_entry_by_txt(name, rdn.substr(0, eq).c_str(), MBSTRING_ASC,
+      reinterpret_cast<const unsigned char *>(rdn.c_str() + eq + 1), -1, -1,
+      0);
+    pos = end + 1;
+  }
+  X509_set_subject_name(cert, name);
+  X509_set_issuer_name(cert,
+                       issuer ? X509_get_subject_name(issuer) : name);
+  X509_NAME_free(name);
+  X509_gmtime_adj(X509_getm_notBefore(cert), -3600);
+  X509_gmtime_adj(X509_getm_notAfter(cert), 7 * 86400);
+  X509_set_pubkey(cert, pkey);
+  AddExtension(cert, issuer ? issuer : cert, NID_basic_constraints,
+               is_ca ? "critical,CA:TRUE" : "critical,CA:FALSE");
+  AddExtension(cert, issuer ? issuer : cert, NID_key_usage, is_ca ?
+               "critical,keyCertSign,cRLSign" :
+               "critical,digitalSignature,keyEncipherment");
+  X509_sign(cert, issuer ? issuer_key : pkey, EVP_sha256());
+  return cert;
+}
+
+
+struct Pki {
+  Pki() : ca_key(NULL), ca(NULL), voms_key(NULL), voms(NULL), eec_key(NULL),
+          eec(NULL), other_eec(NULL) {}
+
+  EVP_PKEY *ca_key;
+  X509 *ca;
+  EVP_PKEY *voms_key;
+  X509 *voms;
+  EVP_PKEY *eec_key;
+  X509 *eec;
+  X509 *other_eec;  ///< Same issuer and key as eec, different serial
+  string dir;
+};
+
+
+bool WriteFile(const string &path, const string &content) {
+  FILE *fp = fopen(path.c_str(), "w");
+  if (!fp)
+    return false;
+  const bool retval =
+    fwrite(content.data(), 1, content.length(), fp) == content.length();
+  return (fclose(fp) == 0) && retval;
+}
+
+
+/**
+ * Creates the CA directory and the vomsdir with the LSC file of the test VO
+ * in a temporary directory and points the parser there.
+ */
+bool SetupPki(Pki *pki) {
+  char dir[] = "/tmp/cvmfs_test_vomsac.XXXXXX";
+  if (!mkdtemp(dir))
+    return false;
+  pki->dir = dir;
+  pki->ca_key = NewKey();
+  pki->voms_key = NewKey();
+  pki->eec_key = NewKey();
+  pki->ca = NewCert("/DC=org/DC=test/CN=Test CA", 1, pki->ca_key, true, NULL,
+                    NULL);
+  pki->voms = NewCert("/DC=org/DC=test/CN=voms.test.org", 2, pki->voms_key,
+                      false, pki->ca, pki->ca_key);
+  pki->eec = NewCert("/DC=org/DC=test/CN=Alice", 3, pki->eec_key, false,
+                     pki->ca, pki->ca_key);
+  pki->other_eec = NewCert("/DC=org/DC=test/CN=Alice", 4, pki->eec_key, false,
+                           pki->ca, pki->ca_key);
+
+  const string cert_dir = pki->dir + "/certificates";
+  const string vo_dir = pki->dir + "/vomsdir/testvo";
+  mkdir(cert_dir.c_str(), 0700);
+  mkdir((pki->dir + "/vomsdir").c_str(), 0700);
+  mkdir(vo_dir.c_str(), 0700);
+  char hash_name[16];
+  snprintf(hash_name, sizeof(hash_name), "%08lx.0",
+           X509_NAME_hash(X509_get_subject_name(pki->ca)));
+  BIO *bio = BIO_new_file((cert_dir + "/" + hash_name).c_str(), "w");
+  if (!bio || !PEM_write_bio_X509(bio, pki->ca))
+    return false;
+  BIO_free(bio);
+  if (!WriteFile(vo_dir + "/voms.test.org.lsc",
+                 "/DC=org/DC=test/CN=voms.test.org\n"
+                 "/DC=org/DC=test/CN=Test CA\n"))
+  {
+    return false;
+  }
+  setenv("X509_CERT_DIR", cert_dir.c_str(), 1);
+  setenv("X509_VOMS_DIR", (pki->dir + "/vomsdir").c_str(), 1);
+  return true;
+}
+
+
+void CleanupPki(const Pki &pki) {
+  unlink((pki.dir + "/vomsdir/testvo/voms.test.org.lsc").c_str());
+  rmdir((pki.dir + "/vomsdir/testvo").c_str());
+  rmdir((pki.dir + "/vomsdir").c_str());
+  char hash_name[16];
+  snprintf(hash_name, sizeof(hash_name), "%08lx.0",
+           X509_NAME_hash(X509_get_subject_name(pki.ca)));
+  unlink((pki.dir + "/certificates/" + hash_name).c_str());
+  rmdir((pki.dir + "/certificates").c_str());
+  rmdir(pki.dir.c_str());
+}
+
+
+//------------------------------------------------------------------------------
+// Attribute certificates
+
+
+struct AcSpec {
+  AcSpec() : not_before(time(NULL) - 600), not_after(time(NULL) + 3600),
+             holder(NULL) {}
+
+  time_t not_before;
+  time_t not_after;
+  X509 *holder;
+  vector<string> fqans;
+};
+
+
+/**
+ * An AC as issued by voms-proxy-init: the VOMS attribute, the VOMS server
+ * certificate in ACCERTS, and the non-critical extensions VOMS adds.
+ */
+string IssueAc(const Pki &pki, const AcSpec &spec) {
+  const string sig_alg = Seq(Oid("1.2.840.113549.1.1.11") + Der(0x05, ""));
+  const string holder = Seq(Der(0xa0,
+    DirectoryName(X509_get_issuer_name(spec.holder)) + SerialOf(spec.holder)));
+  const string issuer = Der(0xa0,
+    DirectoryName(X509_get_subject_name(pki.voms)));
+
+  string fqans;
+  for (unsigned i = 0; i < spec.fqans.size(); ++i)
+    fqans += Der(0x04, spec.fqans[i]);
+  const string policy_authority = Der(0xa0,
+    Der(0x86, "testvo://voms.test.org:15000"));
+  const string attributes = Seq(Seq(
+    Oid("1.3.6.1.4.1.8005.100.100.4") +
+    Der(0x31, Seq(policy_authority + Seq(fqans)))));
+
+  const string extensions = Seq(
+    Seq(Oid("2.5.29.56") + Der(0x04, Der(0x05, ""))) +
+    Seq(Oid("1.3.6.1.4.1.8005.100.100.10") +
+        Der(0x04, Seq(Seq(CertDer(pki.voms))))));
+
+  const string info = Seq(
+    Integer(1) + holder + issuer + sig_alg + Integer(42) +
+    Seq(GeneralizedTime(spec.not_before) + GeneralizedTime(spec.not_after)) +
+    attributes + extensions);
+
+  EVP_MD_CTX *md_ctx = EVP_MD_CTX_new();
+  size_t sig_len = EVP_PKEY_size(pki.voms_key);
+  vector<unsigned char> sig(sig_len);
+  EVP_DigestSignInit(md_ctx, NULL, EVP_sha256(), NULL, pki.voms_key);
+  EVP_DigestSignUpdate(md_ctx, info.data(), info.length());
+  EVP_DigestSignFinal(md_ctx, &sig[0], &sig_len);
+  EVP_MD_CTX_free(md_ctx);
+  const string signature = Der(0x03, string(1, '\0') +
+    string(reinterpret_cast<char *>(&sig[0]), sig_len));
+
+  return Seq(info + sig_alg + signature);
+}
+
+/**
+ * The value of the proxy's AC extension: SEQUENCE { SEQUENCE OF AC }
+ */
+string AcExtension(const string &ac) {
+  return Seq(Seq(ac));
+}
+
+
+bool Parse(const string &extension, X509 *eec,
+           vector<VomsAttributes> *attributes, time_t *not_after)
+{
+  VomsAcParser parser;
+  vector<string> extensions;
+  // Copy into an exactly sized buffer so that overreads are caught by
+  // the address sanitizer
+  extensions.push_back(string(extension.data(), extension.length()));
+  *not_after = numeric_limits<time_t>::max();
+  return parser.Parse(extensions, eec, attributes, not_after);
+}
+
+
+bool SameAttributes(const vector<VomsAttributes> &a,
+                    const vector<VomsAttributes> &b)
+{
+  if (a.size() != b.size())
+    return false;
+  for (unsigned i = 0; i < a.size(); ++i) {
+    if ((a[i].voname != b[i].voname) ||
+        (a[i].fqans.size() != b[i].fqans.size()))
+    {
+      return false;
+    }
+    for (unsigned j = 0; j < a[i].fqans.size(); ++j) {
+      if ((a[i].fqans[j].group != b[i].fqans[j].group) ||
+          (a[i].fqans[j].role != b[i].fqans[j].role))
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Tests
+
+
+void TestValid(const Pki &pki, const AcSpec &spec, const string &extension) {
+  vector<VomsAttributes> attributes;
+  time_t not_after;
+  CHECK(Parse(extension, pki.eec, &attributes, &not_after));
+  CHECK(not_after == spec.not_after);
+  CHECK(attributes.size() == 1);
+  if (attributes.size() != 1)
+    return;
+  CHECK(attributes[0].voname == "testvo");
+  CHECK(attributes[0].fqans.size() == 3);
+  if (attributes[0].fqans.size() != 3)
+    return;
+  CHECK(attributes[0].fqans[0].group == "/testvo");
+  CHECK(attributes[0].fqans[0].role == "NULL");
+  CHECK(attributes[0].fqans[1].group == "/testvo/prod");
+  CHECK(attributes[0].fqans[1].role == "pilot");
+  CHECK(attributes[0].fqans[2].group == "/testvo/analysis");
+  CHECK(attributes[0].fqans[2].role == "NULL");
+
+  // The end of validity is only ever lowered
+  VomsAcParser parser;
+  vector<string> extensions(1, extension);
+  not_after = spec.not_after - 60;
+  CHECK(parser.Parse(extensions, pki.eec, &attributes, &not_after));
+  CHECK(not_after == spec.not_after - 60);
+}
+
+
+void TestTruncated(const Pki &pki, const string &extension) {
+  for (size_t length = 0; length < extension.length(); ++length) {
+    vector<VomsAttributes> attributes;
+    time_t not_after;
+    CHECK(!Parse(extension.substr(0, length), pki.eec, &attributes,
+                 &not_after));
+  }
+}
+
+
+/**
+ * Lengths beyond the end of the buffer, at the outermost level and at the
+ * length field of every node
+ */
+void TestOversizedLength(const Pki &pki, const string &extension) {
+  vector<VomsAttributes> attributes;
+  time_t not_after;
+  // The extension is longer than 127 bytes, so its length is in long form
+  string oversized = extension;
+  oversized.replace(1, 1 + (oversized[1] & 0x7f), "\x84\x7f\xff\xff\xff");
+  CHECK(!Parse(oversized, pki.eec, &attributes, &not_after));
+  oversized.replace(1, 5, "\x88\xff\xff\xff\xff\xff\xff\xff\xff");
+  CHECK(!Parse(oversized, pki.eec, &attributes, &not_after));
+  // Indefinite length is not DER
+  oversized = extension;
+  oversized.replace(1, 1 + (oversized[1] & 0x7f), "\x80");
+  CHECK(!Parse(oversized + string(2, '\0'), pki.eec, &attributes,
+               &not_after));
+}
+
+
+/**
+ * Replaces every byte by values that turn it into an oversized or
+ * indefinite length, a different tag, or garbage.  A mutated AC may only be
+ * accepted if the mutation did not touch anything that is interpreted (e.g.
+ * the tag of the outer wrapper) and the result is unchanged.
+ */
+void TestMutations(const Pki &pki, const string &extension) {
+  vector<VomsAttributes> expected;
+  time_t expected_not_after;
+  Parse(extension, pki.eec, &expected, &expected_not_after);
+  const unsigned char values[] = {0x00, 0x01, 0x7f, 0x80, 0x81, 0x82, 0x84,
+                                  0xff};
+  for (size_t pos = 0; pos < extension.length(); ++pos) {
+    for (unsigned i = 0; i < sizeof(values); ++i) {
+      string mutated = extension;
+      if (static_cast<unsigned char>(mutated[pos]) == values[i])
+        continue;
+      mutated[pos] = static_cast<char>(values[i]);
+      vector<VomsAttributes> attributes;
+      time_t not_after;
+      if (Parse(mutated, pki.eec, &attributes, &not_after)) {
+        CHECK(SameAttributes(attributes, expected));
+        CHECK(not_after == expected_not_after);
+      }
+    }
+  }
+}
+
+
+void TestWrongHolder(const Pki &pki, const AcSpec &spec) {
+  AcSpec other_spec = spec;
+  other_spec.holder = pki.other_eec;
+  const string extension = AcExtension(IssueAc(pki, other_spec));
+  vector<VomsAttributes> attributes;
+  time_t not_after;
+  CHECK(!Parse(extension, pki.eec, &attributes, &not_after));
+  CHECK(Parse(extension, pki.other_eec, &attributes, &not_after));
+}
+
+
+void TestBadSignature(const Pki &pki, const string &ac) {
+  vector<VomsAttributes> attributes;
+  time_t not_after;
+  string forged = ac;
+  forged[forged.length() - 1] ^= 0x01;
+  CHECK(!Parse(AcExtension(forged), pki.eec, &attributes, &not_after));
+
+  // Signed by a key that is not the one of the VOMS server certificate
+  Pki impostor = pki;
+  impostor.voms_key = pki.eec_key;
+  AcSpec spec;
+  spec.holder = pki.eec;
+  spec.fqans.push_back("/testvo/Role=NULL/Capability=NULL");
+  CHECK(!Parse(AcExtension(IssueAc(impostor, spec)), pki.eec, &attributes,
+               &not_after));
+
+  // Issued by a VOMS server that is not in the LSC file
+  impostor.voms = pki.other_eec;
+  CHECK(!Parse(AcExtension(IssueAc(impostor, spec)), pki.eec, &attributes,
+               &not_after));
+}
+
+
+void TestValidity(const Pki &pki, const AcSpec &spec) {
+  vector<VomsAttributes> attributes;
+  time_t not_after;
+  AcSpec expired = spec;
+  expired.not_before = time(NULL) - 7200;
+  expired.not_after = time(NULL) - 3600;
+  CHECK(!Parse(AcExtension(IssueAc(pki, expired)), pki.eec, &attributes,
+               &not_after));
+  AcSpec future = spec;
+  future.not_before = time(NULL) + 3600;
+  future.not_after = time(NULL) + 7200;
+  CHECK(!Parse(AcExtension(IssueAc(pki, future)), pki.eec, &attributes,
+               &not_after));
+}
+
+
+//------------------------------------------------------------------------------
+// Comparison with libvomsapi
+
+
+X509 *NewProxy(const Pki &pki, const string &ac_extension) {
+  X509 *proxy = X509_new();
+  X509_set_version(proxy, 2);
+  ASN1_INTEGER_set(X509_get_serialNumber(proxy), 1234);
+  X509_NAME *name = X509_NAME_dup(X509_get_subject_name(pki.eec));
+  X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+    reinterpret_cast<const unsigned char *>("1234"), -1, -1, 0);
+  X509_set_subject_name(proxy, name);
+  X509_NAME_free(name);
+  X509_set_issuer_name(proxy, X509_get_subject_name(pki.eec));
+  X509_gmtime_adj(X509_getm_notBefore(proxy), -600);
+  X509_gmtime_adj(X509_getm_notAfter(proxy), 86400);
+  X509_set_pubkey(proxy, pki.eec_key);
+  ASN1_OCTET_STRING *value = ASN1_OCTET_STRING_new();
+  ASN1_OCTET_STRING_set(value,
+    reinterpret_cast<const unsigned char *>(ac_extension.data()),
+    ac_extension.length());
+  ASN1_OBJECT *oid = OBJ_txt2obj("1.3.6.1.4.1.8005.100.100.5", 1);
+  X509_EXTENSION *ext = X509_EXTENSION_create_by_OBJ(NULL, oid, 0, value);
+  X509_add_ext(proxy, ext, -1);
+  X509_EXTENSION_free(ext);
+  ASN1_OBJECT_free(oid);
+  ASN1_OCTET_STRING_free(value);
+  X509_sign(proxy, pki.eec_key, EVP_sha256());
+  return proxy;
+}
+
+
+int CompareWithLibvomsapi(const Pki &pki, const AcSpec &spec,
+                          const string &extension)
+{
+  void *handle;
+  if (!OpenDynLib(&handle, "libvomsapi.so.1", "VOMS")) {
+    printf("libvomsapi not available, skipping\n");
+    return kSkipTest;
+  }
+  CloseDynLib(&handle, "VOMS");
+
+  unsetenv("CVMFS_X509_VOMS_PARSER");
+  VomsLib *voms = VomsLib::GetInstance();
+  CHECK(voms->IsValid());
+  X509 *proxy = NewProxy(pki, extension);
+  STACK_OF(X509) *chain = sk_X509_new_null();
+  sk_X509_push(chain, pki.eec);
+  FqanIndex libvomsapi_fqans;
+  time_t libvomsapi_not_after = numeric_limits<time_t>::max();
+  CHECK(voms->GetAttributes(proxy, chain, pki.eec, &libvomsapi_fqans,
+                            &libvomsapi_not_after));
+  sk_X509_free(chain);
+  X509_free(proxy);
+
+  vector<VomsAttributes> attributes;
+  time_t native_not_after;
+  CHECK(Parse(extension, pki.eec, &attributes, &native_not_after));
+  FqanIndex native_fqans;
+  native_fqans.Build(attributes);
+
+  CHECK(native_not_after == libvomsapi_not_after);
+  CHECK(native_not_after == spec.not_after);
+  const char *groups[] = {"/testvo", "/testvo/prod", "/testvo/analysis",
+                          "/testvo/other", "/othervo"};
+  const char *roles[] = {"NULL", "pilot", "production"};
+  for (unsigned i = 0; i < sizeof(groups) / sizeof(groups[0]); ++i) {
+    vector<string> hierarchy;
+    SplitGroupToPaths(groups[i], &hierarchy);
+    const string vo = hierarchy[0];
+    for (unsigned j = 0; j < sizeof(roles) / sizeof(roles[0]); ++j) {
+      CHECK(native_fqans.Matches(vo, hierarchy, false, roles[j]) ==
+            libvomsapi_fqans.Matches(vo, hierarchy, false, roles[j]));
+    }
+    CHECK(native_fqans.Matches(vo, hierarchy, true, "") ==
+          libvomsapi_fqans.Matches(vo, hierarchy, true, ""));
+  }
+  return 0;
+}
+
+}  // anonymous namespace
+
+
+int main(int argc, char **argv) {
+  Pki pki;
+  if (!SetupPki(&pki)) {
+    fprintf(stderr, "cannot set up test PKI\n");
+    return 1;
+  }
+  AcSpec spec;
+  spec.holder = pki.eec;
+  spec.fqans.push_back("/testvo/Role=NULL/Capability=NULL");
+  spec.fqans.push_back("/testvo/prod/Role=pilot/Capability=NULL");
+  spec.fqans.push_back("/testvo/analysis/Role=NULL/Capability=NULL");
+  const string ac = IssueAc(pki, spec);
+  const string extension = AcExtension(ac);
+
+  int retval = 0;
+  if ((argc > 1) && (strcmp(argv[1], "--libvomsapi") == 0)) {
+    retval = CompareWithLibvomsapi(pki, spec, extension);
+  } else {
+    TestValid(pki, spec, extension);
+    TestTruncated(pki, extension);
+    TestOversizedLength(pki, extension);
+    TestMutations(pki, extension);
+    TestWrongHolder(pki, spec);
+    TestBadSignature(pki, ac);
+    TestValidity(pki, spec);
+  }
+
+  CleanupPki(pki);
+  X509_free(pki.other_eec);
+  X509_free(pki.eec);
+  X509_free(pki.voms);
+  X509_free(pki.ca);
+  EVP_PKEY_free(pki.eec_key);
+  EVP_PKEY_free(pki.voms_key);
+  EVP_PKEY_free(pki.ca_key);
+  if (g_failures > 0) {
+    fprintf(stderr, "%u checks failed\n", g_failures);
+    return 1;
+  }
+  return retval;
+}